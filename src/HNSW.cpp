@@ -0,0 +1,258 @@
+#include "HNSW.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <queue>
+#include <stdexcept>
+#include "utils.h"
+#include "vec.h"
+
+namespace {
+    inline float dist(const float* q, const Vec::Rows& R, uint32_t r) {
+        return 1.0f - R.dot(q, r);
+    }
+
+    // Row r as f32: in place for F32 rows, else dequantized into buf
+    inline const float* rowf(const Vec::Rows& R, uint32_t r, std::vector<float>& buf) {
+        if (R.type == Vec::Type::F32) return static_cast<const float*>(R.base) + r * R.stride;
+        buf.resize(R.dim);
+        R.get(r, buf.data());
+        return buf.data();
+    }
+
+    // uint32 arrays in the index file are little-endian whatever the host
+    void write32(std::ofstream& f, const uint32_t* v, size_t n) {
+        std::vector<char> buf(n * 4);
+        for (size_t i = 0; i < n; ++i) put32(&buf[i * 4], v[i]);
+        f.write(buf.data(), buf.size());
+    }
+    void read32(std::ifstream& f, uint32_t* v, size_t n) {
+        std::vector<char> buf(n * 4);
+        f.read(buf.data(), buf.size());
+        for (size_t i = 0; i < n; ++i) v[i] = le32(&buf[i * 4]);
+    }
+}
+
+HNSW::HNSW(size_t m, size_t ef) : M(m), M0(2 * m), efC(ef), mL(1.0 / std::log(static_cast<double>(m))) {}
+
+void HNSW::clear() {
+    lvl.clear();
+    L0.clear();
+    up.clear();
+    entry = 0;
+    maxL = -1;
+}
+
+uint32_t* HNSW::links(uint32_t id, int l) {
+    return l == 0 ? &L0[id * (M0 + 1)] : &up[id][(l - 1) * (M + 1)];
+}
+
+const uint32_t* HNSW::links(uint32_t id, int l) const {
+    return l == 0 ? &L0[id * (M0 + 1)] : &up[id][(l - 1) * (M + 1)];
+}
+
+// Best-first search of one level from entry point ep; returns up to ef hits, nearest first
+std::vector<HNSW::Hit> HNSW::layer(const float* q, uint32_t ep, size_t ef, int l, const Vec::Rows& R) const {
+    // Visited marks are generation-tagged so concurrent const searches never share state
+    thread_local std::vector<uint32_t> mark;
+    thread_local uint32_t tag = 0;
+    if (mark.size() < lvl.size()) mark.resize(lvl.size(), 0);
+    if (++tag == 0) {
+        std::fill(mark.begin(), mark.end(), 0);
+        tag = 1;
+    }
+
+    auto far = [](const Hit& a, const Hit& b) { return a.second < b.second; };  // max-heap on distance
+    auto near = [](const Hit& a, const Hit& b) { return a.second > b.second; }; // min-heap on distance
+    std::priority_queue<Hit, std::vector<Hit>, decltype(near)> cand(near);
+    std::priority_queue<Hit, std::vector<Hit>, decltype(far)> res(far);
+
+    float d = dist(q, R, ep);
+    cand.emplace(ep, d);
+    res.emplace(ep, d);
+    mark[ep] = tag;
+
+    while (!cand.empty()) {
+        Hit c = cand.top();
+        if (c.second > res.top().second && res.size() >= ef) break;
+        cand.pop();
+        const uint32_t* nb = links(c.first, l);
+        for (uint32_t j = 1; j <= nb[0]; ++j) {
+            uint32_t v = nb[j];
+            if (mark[v] == tag) continue;
+            mark[v] = tag;
+            float dv = dist(q, R, v);
+            if (res.size() < ef || dv < res.top().second) {
+                cand.emplace(v, dv);
+                res.emplace(v, dv);
+                if (res.size() > ef) res.pop();
+            }
+        }
+    }
+
+    std::vector<Hit> out(res.size());
+    for (size_t i = out.size(); i-- > 0; res.pop()) out[i] = res.top();
+    return out;
+}
+
+// Neighbour selection heuristic: keep a candidate only if it is closer to the query than to every
+// neighbour already kept, which spreads links across clusters. cand must be sorted nearest first.
+std::vector<uint32_t> HNSW::select(std::vector<Hit>& cand, size_t m, const Vec::Rows& R) const {
+    std::vector<uint32_t> keep;
+    std::vector<float> buf;
+    for (const auto& [c, dc] : cand) {
+        if (keep.size() >= m) break;
+        bool good = true;
+        const float* cr = rowf(R, c, buf);
+        for (uint32_t r : keep) {
+            if (dist(cr, R, r) < dc) {
+                good = false;
+                break;
+            }
+        }
+        if (good) keep.push_back(c);
+    }
+    return keep;
+}
+
+// Link id to nb on level l in both directions, shrinking neighbour lists that overflow
+void HNSW::connect(uint32_t id, int l, const std::vector<uint32_t>& nb, const Vec::Rows& R) {
+    size_t cap = l == 0 ? M0 : M;
+    uint32_t* own = links(id, l);
+    own[0] = static_cast<uint32_t>(nb.size());
+    std::copy(nb.begin(), nb.end(), own + 1);
+
+    for (uint32_t v : nb) {
+        uint32_t* vl = links(v, l);
+        if (vl[0] < cap) {
+            vl[++vl[0]] = id;
+            continue;
+        }
+        std::vector<float> buf;
+        const float* vr = rowf(R, v, buf);
+        std::vector<Hit> cand;
+        cand.reserve(cap + 1);
+        for (uint32_t j = 1; j <= vl[0]; ++j) cand.emplace_back(vl[j], dist(vr, R, vl[j]));
+        cand.emplace_back(id, dist(vr, R, id));
+        std::sort(cand.begin(), cand.end(), [](const Hit& a, const Hit& b) { return a.second < b.second; });
+        auto kept = select(cand, cap, R);
+        vl[0] = static_cast<uint32_t>(kept.size());
+        std::copy(kept.begin(), kept.end(), vl + 1);
+    }
+}
+
+void HNSW::add(uint32_t id, const Vec::Rows& R) {
+    if (id != lvl.size()) {
+        throw std::runtime_error("HNSW rows must be added in order.");
+    }
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    int l = std::min(static_cast<int>(-std::log(1.0 - u(gen)) * mL), 255);
+    lvl.push_back(static_cast<uint8_t>(l));
+    L0.resize(lvl.size() * (M0 + 1), 0);
+    up.emplace_back(l * (M + 1), 0);
+
+    if (maxL < 0) {
+        entry = id;
+        maxL = l;
+        return;
+    }
+
+    std::vector<float> buf;
+    const float* q = rowf(R, id, buf);
+    uint32_t ep = entry;
+    for (int lc = maxL; lc > l; --lc) {
+        ep = layer(q, ep, 1, lc, R)[0].first;
+    }
+    for (int lc = std::min(l, maxL); lc >= 0; --lc) {
+        auto w = layer(q, ep, efC, lc, R);
+        connect(id, lc, select(w, lc == 0 ? M0 : M, R), R);
+        ep = w[0].first;
+    }
+    if (l > maxL) {
+        entry = id;
+        maxL = l;
+    }
+}
+
+std::vector<HNSW::Hit> HNSW::search(const float* q, size_t k, const Vec::Rows& R, size_t ef) const {
+    if (maxL < 0 || k == 0) return {};
+    uint32_t ep = entry;
+    for (int lc = maxL; lc > 0; --lc) {
+        ep = layer(q, ep, 1, lc, R)[0].first;
+    }
+    auto w = layer(q, ep, std::max(ef, k), 0, R);
+    if (w.size() > k) w.resize(k);
+    return w;
+}
+
+// Save links to a binary file
+void HNSW::save(const std::string& path, uint64_t tag) const {
+    std::ofstream f(path, std::ios::binary);
+    if (!f.is_open()) {
+        throw std::runtime_error("Failed to open file for saving index.");
+    }
+    uint32_t hdr[8] = {0x4E484958u /* "XIHN" */, 2, static_cast<uint32_t>(M),
+                       static_cast<uint32_t>(lvl.size()), entry, static_cast<uint32_t>(maxL),
+                       static_cast<uint32_t>(tag), static_cast<uint32_t>(tag >> 32)};
+    write32(f, hdr, 8);
+    f.write(reinterpret_cast<const char*>(lvl.data()), lvl.size());
+    write32(f, L0.data(), L0.size());
+    for (const auto& u : up) {
+        write32(f, u.data(), u.size());
+    }
+    if (!f) {
+        throw std::runtime_error("Failed to write index.");
+    }
+}
+
+// Load links saved by save(); M must match this index. Every level, count and link is checked so that
+// a corrupt file cannot send search() out of bounds.
+uint64_t HNSW::load(const std::string& path) {
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if (!f.is_open()) {
+        throw std::runtime_error("Failed to open index file.");
+    }
+    uint64_t bytes = static_cast<uint64_t>(f.tellg());
+    f.seekg(0);
+    uint32_t hdr[8];
+    read32(f, hdr, 8);
+    if (!f || hdr[0] != 0x4E484958u || hdr[1] != 2 || hdr[2] != M) {
+        throw std::runtime_error("Unsupported index file.");
+    }
+    size_t n = hdr[3];
+    // Level 0 alone needs this much; reject before allocating for a corrupt count
+    if (n * (1 + (M0 + 1) * sizeof(uint32_t)) > bytes - sizeof(hdr)) {
+        throw std::runtime_error("Truncated index file.");
+    }
+    clear();
+    lvl.resize(n);
+    L0.resize(n * (M0 + 1));
+    f.read(reinterpret_cast<char*>(lvl.data()), n);
+    read32(f, L0.data(), L0.size());
+    up.resize(n);
+    for (size_t i = 0; i < n && f; ++i) {
+        up[i].resize(lvl[i] * (M + 1));
+        read32(f, up[i].data(), up[i].size());
+    }
+    if (!f) {
+        clear();
+        throw std::runtime_error("Failed to read index.");
+    }
+    entry = hdr[4];
+    maxL = static_cast<int>(hdr[5]);
+
+    bool ok = n == 0 ? maxL == -1 : entry < n && maxL == lvl[entry];
+    for (size_t i = 0; i < n && ok; ++i) {
+        ok = lvl[i] <= maxL;
+        for (int l = 0; l <= lvl[i] && ok; ++l) {
+            const uint32_t* nb = links(static_cast<uint32_t>(i), l);
+            ok = nb[0] <= (l == 0 ? M0 : M);
+            for (uint32_t j = 1; j <= nb[0] && ok; ++j) ok = nb[j] < n && lvl[nb[j]] >= l; // Target is on level l
+        }
+    }
+    if (!ok) {
+        clear();
+        throw std::runtime_error("Corrupt index file.");
+    }
+    return static_cast<uint64_t>(hdr[7]) << 32 | hdr[6];
+}
@@ -0,0 +1,59 @@
+#ifndef HNSW_H
+#define HNSW_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <random>
+#include <cstdint>
+#include "vec.h"
+
+/**
+ * @class HNSW
+ * Hierarchical navigable small-world graph for approximate nearest-neighbour search over the rows
+ * of a row-major matrix by distance 1 - dot (cosine distance for unit rows and queries), in any Vec::Type. The index stores
+ * only links; rows are passed in on each call because the owner's slab may move as it grows.
+ * Nodes are row IDs and must be added in order 0, 1, 2, ...
+ */
+class HNSW {
+public:
+    using Hit = std::pair<uint32_t, float>; // (row ID, distance)
+
+    explicit HNSW(size_t M = 16, size_t efC = 100);
+
+    size_t size() const { return lvl.size(); }
+    void clear();
+
+    // Insert row id == size()
+    void add(uint32_t id, const Vec::Rows& R);
+
+    /**
+     * @brief Approximate k nearest rows to q.
+     * @param ef Search breadth (>= k); larger is more accurate and slower.
+     * @return Hits sorted by increasing distance.
+     */
+    std::vector<Hit> search(const float* q, size_t k, const Vec::Rows& R, size_t ef = 64) const;
+
+    // Persistence (links only). `tag` identifies the rows the links were built over; load() checks the
+    // file's structure and returns the saved tag for the owner to compare.
+    void save(const std::string& path, uint64_t tag = 0) const;
+    uint64_t load(const std::string& path);
+
+private:
+    size_t M, M0, efC;                       // Max links per upper level / level 0, build breadth
+    double mL;                               // Level multiplier 1/ln(M)
+    std::vector<uint8_t> lvl;                // Top level of each node
+    std::vector<uint32_t> L0;                // Level 0 links: per node [count, ids x M0]
+    std::vector<std::vector<uint32_t>> up;   // Levels 1..lvl: per level [count, ids x M]
+    uint32_t entry = 0;                      // Entry point (a node on the top level)
+    int maxL = -1;                           // Top level, -1 when empty
+    std::mt19937 gen{42};                    // Level sampling (deterministic builds)
+
+    uint32_t* links(uint32_t id, int l);
+    const uint32_t* links(uint32_t id, int l) const;
+    std::vector<Hit> layer(const float* q, uint32_t ep, size_t ef, int l, const Vec::Rows& R) const;
+    std::vector<uint32_t> select(std::vector<Hit>& cand, size_t m, const Vec::Rows& R) const;
+    void connect(uint32_t id, int l, const std::vector<uint32_t>& nb, const Vec::Rows& R);
+};
+
+#endif // HNSW_H
@@ -15,79 +15,499 @@
 #include <algorithm>
 #include <numeric>
 #include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <bit>
+#include <charconv>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <system_error>
 #include "LM.h"
 #include "utils.h"
+#include "vec.h"
+#include "pool.h"
+#include "rng.h"
+
+namespace {
+    constexpr size_t HDR = 128; // Model file header size (also aligns the matrix)
+
+    struct Hdr {
+        uint32_t dim, stride, dtype;
+        uint64_t rows, matOff, strOff, hashOff, hashSize, scaleOff;
+    };
+
+    // off + count * size, or UINT64_MAX if that overflows (fails every bounds check below)
+    inline uint64_t extent(uint64_t off, uint64_t count, uint64_t size) {
+        if (size && count > (UINT64_MAX - off) / size) return UINT64_MAX;
+        return off + count * size;
+    }
+
+    // Validate a model file header, its section bounds and the tables word()/id() index without checks:
+    // string offsets must be monotonic and inside the string section, and every hash slot must be empty or
+    // name a row, with at least one empty slot so that probing terminates.
+    Hdr header(const char* p, size_t n) {
+        if (n < HDR || std::memcmp(p, "XILM", 4) != 0) throw std::runtime_error("Not a model file.");
+        if (le32(p + 4) != 2) throw std::runtime_error("Unsupported model version.");
+        if (le32(p + 8) != 0x01020304u) throw std::runtime_error("Corrupt model header.");
+        Hdr h{le32(p + 12), le32(p + 16), le32(p + 20), le64(p + 24), le64(p + 32), le64(p + 40), le64(p + 48),
+              le64(p + 56), le64(p + 72)};
+        if (h.dtype > 2) throw std::runtime_error("Unsupported model data type.");
+        size_t w = Vec::width(static_cast<Vec::Type>(h.dtype));
+        uint64_t matEnd = extent(h.matOff, h.rows, uint64_t(h.stride) * w);
+        if (h.dtype == 2) {
+            if (h.scaleOff % 8 != 0 || h.scaleOff < matEnd) throw std::runtime_error("Corrupt model file.");
+            matEnd = extent(h.scaleOff, h.rows, 4);
+        }
+        uint64_t offEnd = extent(h.strOff, h.rows + 1, 8); // End of the string offsets
+        if (h.rows >= UINT32_MAX || h.stride < h.dim || le64(p + 64) != n || h.matOff % 64 != 0 ||
+            h.strOff % 8 != 0 || h.hashOff % 8 != 0 || (h.hashSize & (h.hashSize - 1)) != 0 ||
+            h.hashSize <= h.rows || matEnd > h.strOff || offEnd > h.hashOff || h.hashOff > n ||
+            extent(h.hashOff, h.hashSize, 4) > n) {
+            throw std::runtime_error("Corrupt model file.");
+        }
+
+        uint64_t bytes = h.hashOff - offEnd; // Room for string bytes
+        uint64_t prev = 0;
+        for (uint64_t i = 0; i <= h.rows; ++i) {
+            uint64_t o = le64(p + h.strOff + i * 8);
+            if (o < prev || o > bytes || (i == 0 && o != 0)) throw std::runtime_error("Corrupt model string table.");
+            prev = o;
+        }
+        uint64_t empty = 0;
+        for (uint64_t i = 0; i < h.hashSize; ++i) {
+            uint32_t v = le32(p + h.hashOff + i * 4);
+            if (v == 0) ++empty;
+            else if (v - 1 >= h.rows) throw std::runtime_error("Corrupt model hash table.");
+        }
+        if (empty == 0) throw std::runtime_error("Corrupt model hash table.");
+        return h;
+    }
+}
+
+namespace {
+    // Append s to out as the body of a JSON string
+    void jsonEscape(std::string& out, std::string_view s) {
+        static const char hex[] = "0123456789abcdef";
+        for (unsigned char c : s) {
+            switch (c) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                case '\b': out += "\\b"; break;
+                case '\f': out += "\\f"; break;
+                default:
+                    if (c < 0x20) {
+                        out += "\\u00";
+                        out += hex[c >> 4];
+                        out += hex[c & 15];
+                    } else {
+                        out += static_cast<char>(c);
+                    }
+            }
+        }
+    }
+
+    // Parsed records of one slice of an embeddings file
+    struct Records {
+        std::vector<std::string> words;
+        std::vector<size_t> offs{0}; // Vector of words[i] is vals[offs[i], offs[i + 1])
+        std::vector<float> vals;
+    };
+
+    // Reader for the embeddings JSON shape: { "word": [numbers], ... }
+    struct JsonReader {
+        const char* b; // File start (for error offsets)
+        const char* p;
+        const char* e;
+
+        [[noreturn]] void fail(const std::string& what) const {
+            throw std::runtime_error("Invalid embeddings JSON: " + what + " at byte " + std::to_string(p - b) + ".");
+        }
+        void ws() {
+            while (p < e && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+        }
+        void expect(char c) {
+            ws();
+            if (p >= e || *p != c) fail(std::string("expected '") + c + "'");
+            ++p;
+        }
+        uint32_t hex4() {
+            if (e - p < 4) fail("truncated \\u escape");
+            uint32_t v = 0;
+            for (int i = 0; i < 4; ++i, ++p) {
+                char c = *p;
+                v <<= 4;
+                if (c >= '0' && c <= '9') v |= c - '0';
+                else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+                else fail("bad \\u escape");
+            }
+            return v;
+        }
+        void str(std::string& out) {
+            expect('"');
+            out.clear();
+            for (;;) {
+                const char* run = p;
+                while (p < e && *p != '"' && *p != '\\' && static_cast<unsigned char>(*p) >= 0x20) ++p;
+                out.append(run, p);
+                if (p >= e) fail("unterminated string");
+                char c = *p++;
+                if (c == '"') return;
+                if (c != '\\') fail("control character in string");
+                if (p >= e) fail("unterminated string");
+                switch (*p++) {
+                    case '"': out += '"'; break;
+                    case '\\': out += '\\'; break;
+                    case '/': out += '/'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u': {
+                        uint32_t cp = hex4();
+                        if (cp >= 0xD800 && cp < 0xDC00) { // Surrogate pair
+                            if (e - p < 2 || p[0] != '\\' || p[1] != 'u') fail("unpaired surrogate");
+                            p += 2;
+                            uint32_t lo = hex4();
+                            if (lo < 0xDC00 || lo >= 0xE000) fail("unpaired surrogate");
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                        }
+                        if (cp < 0x80) {
+                            out += static_cast<char>(cp);
+                        } else if (cp < 0x800) {
+                            out += static_cast<char>(0xC0 | (cp >> 6));
+                            out += static_cast<char>(0x80 | (cp & 0x3F));
+                        } else if (cp < 0x10000) {
+                            out += static_cast<char>(0xE0 | (cp >> 12));
+                            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                            out += static_cast<char>(0x80 | (cp & 0x3F));
+                        } else {
+                            out += static_cast<char>(0xF0 | (cp >> 18));
+                            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+                            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                            out += static_cast<char>(0x80 | (cp & 0x3F));
+                        }
+                        break;
+                    }
+                    default: --p; fail("bad escape");
+                }
+            }
+        }
+        void vec(std::vector<float>& out) {
+            expect('[');
+            ws();
+            if (p < e && *p == ']') {
+                ++p;
+                return;
+            }
+            for (;;) {
+                ws();
+                float f;
+                auto [end, ec] = std::from_chars(p, e, f);
+                if (ec == std::errc::result_out_of_range) {
+                    f = std::strtof(std::string(p, end).c_str(), nullptr); // Under/overflow: 0 or +-inf
+                } else if (ec != std::errc()) {
+                    fail("expected a number");
+                }
+                p = end;
+                out.push_back(f);
+                ws();
+                if (p < e && *p == ',') {
+                    ++p;
+                } else if (p < e && *p == ']') {
+                    ++p;
+                    return;
+                } else {
+                    fail("expected ',' or ']'");
+                }
+            }
+        }
+
+        // Parse records whose key starts before stop; the last slice also takes the closing brace
+        void records(const char* stop, bool last, Records& out) {
+            std::string key;
+            for (;;) {
+                ws();
+                if (p >= stop) {
+                    if (last) fail("expected '}'");
+                    return;
+                }
+                if (*p == '}') {
+                    if (!last) fail("unexpected '}'");
+                    ++p;
+                    ws();
+                    if (p != e) fail("trailing data");
+                    return;
+                }
+                str(key);
+                expect(':');
+                vec(out.vals);
+                out.words.push_back(key);
+                out.offs.push_back(out.vals.size());
+                ws();
+                if (p < e && *p == ',') ++p;
+                else if (p >= e || *p != '}') fail("expected ',' or '}'");
+            }
+        }
+    };
+
+    // Start of the first record at or after p: a raw newline only occurs between tokens, and the
+    // only token that can follow whitespace with '"' is a key
+    const char* recordStart(const char* p, const char* e) {
+        while ((p = static_cast<const char*>(std::memchr(p, '\n', e - p))) != nullptr) {
+            while (p < e && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+            if (p < e && *p == '"') return p;
+        }
+        return e;
+    }
+}
 
 // Constructor LM(int dim, float lr, float reg, float noise);  LM model(50, 0.01, 0.001, 0.01); - in Xi.cpp
 LM::LM(int d,float l,float r,float n)
 {
-    dim=d;
+    reset(d);
     lr=l;
     reg=r;
     noise=n;
 }
     
-// Generate a random float in the range [0, 1]
-float LM::randomFloat() {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    static std::uniform_real_distribution<float> dis(0.0, 1.0);
-    return dis(gen);
+// Normalize a vector to unit length
+void LM::normalizeVector(float* vec) {
+    Vec::normalize(vec, dim);
 }
 
-// Normalize a vector to unit length
-void LM::normalizeVector(std::vector<float>& vec) {
-    float magnitude = std::sqrt(std::accumulate(vec.begin(), vec.end(), 0.0f, [](float sum, float val) {
-        return sum + val * val;
-    }));
-    if (magnitude > 0) {
-        for (auto& val : vec) {
-            val /= magnitude;
+// Add noise to a vector
+void LM::addNoise(float* vec, float factor) {
+    // Each thread draws from its own stream, so Hogwild workers never share RNG state
+    thread_local std::vector<float> r;
+    r.resize(dim);
+    Rng::fill(r.data(), dim);
+    Vec::axpy(factor, r.data(), vec, dim);
+}
+
+// Clear the vocabulary and set the row layout for dimensionality d
+void LM::reset(int d) {
+    dim = d;
+    stride = (static_cast<size_t>(d) + 7) & ~size_t(7);
+    rows = 0;
+    ids.clear();
+    words.clear();
+    E.clear();
+    Q.clear();
+    Qs.clear();
+    qt = Vec::Type::F32;
+    ann.clear();
+    ep = 0;
+    stamp.clear();
+    flat = 0;
+    mm.reset();
+    mrows = nullptr;
+    mq = nullptr;
+    mqs = nullptr;
+}
+
+// Insert or overwrite a word's row; the first row of an empty vocabulary sets dim
+uint32_t LM::set(const std::string& word, const float* vec, size_t n) {
+    if (rows == 0 && n != static_cast<size_t>(dim)) reset(static_cast<int>(n));
+    if (n != static_cast<size_t>(dim)) {
+        throw std::runtime_error("Embedding dimension mismatch.");
+    }
+    if (stride == 0) reset(dim);
+    writable();
+    own();
+    auto [it, added] = ids.try_emplace(word, static_cast<uint32_t>(rows));
+    if (added) {
+        words.push_back(word);
+        E.resize(++rows * stride, 0.0f);
+        stamp.push_back(ep);
+    } else {
+        if (it->second < ann.size()) ann.clear(); // An indexed row moved
+        stamp[it->second] = ep;                   // Overwritten: nothing pending
+    }
+    std::copy(vec, vec + n, row(it->second));
+    return it->second;
+}
+
+// Row ID for a word, npos if unknown
+uint32_t LM::id(const std::string& word) const {
+    if (mm) {
+        for (uint64_t h = fnv1a(word) & hmask;; h = (h + 1) & hmask) {
+            uint32_t slot = le32(htab + h);
+            if (slot == 0) return npos;
+            if (this->word(slot - 1) == word) return slot - 1;
         }
     }
+    auto it = ids.find(word);
+    return it == ids.end() ? npos : it->second;
 }
 
-// Add noise to a vector
-void LM::addNoise(std::vector<float>& vec, float factor) {
-    for (auto& val : vec) {
-        val += factor * randomFloat();
+std::string_view LM::word(uint32_t id) const {
+    if (mm) {
+        uint64_t b = le64(soff + id), e = le64(soff + id + 1);
+        return {sbuf + b, static_cast<size_t>(e - b)};
+    }
+    return words[id];
+}
+
+// Copy a mapped model into owned storage
+void LM::own() {
+    if (!mm) return;
+    if (qt == Vec::Type::F32) {
+        E.assign(mrows, mrows + rows * stride);
+    } else {
+        Q.assign(mq, mq + rows * stride * Vec::width(qt));
+        if (qt == Vec::Type::I8) Qs.assign(mqs, mqs + rows);
+    }
+    words.clear();
+    words.reserve(rows);
+    ids.clear();
+    ids.reserve(rows);
+    for (uint32_t w = 0; w < rows; ++w) {
+        words.emplace_back(word(w));
+        ids.emplace(words.back(), w);
+    }
+    mm.reset();
+    mrows = nullptr;
+    mq = nullptr;
+    mqs = nullptr;
+}
+
+// Convert rows to type t in memory (F32 dequantizes)
+void LM::quantize(Vec::Type t) {
+    if (t == qt) return;
+    own();
+    Vec::Rows src = view();
+    std::vector<float, AlignedAlloc<float>> e;
+    std::vector<char, AlignedAlloc<char>> q;
+    std::vector<float> qs, tmp(dim);
+    if (t == Vec::Type::F32) {
+        e.assign(rows * stride, 0.0f);
+    } else {
+        q.assign(rows * stride * Vec::width(t), 0);
     }
+    if (t == Vec::Type::I8) qs.resize(rows);
+
+    for (uint32_t w = 0; w < rows; ++w) {
+        src.get(w, tmp.data());
+        switch (t) {
+            case Vec::Type::F32:
+                std::copy(tmp.begin(), tmp.end(), e.data() + w * stride);
+                break;
+            case Vec::Type::F16:
+                Vec::toF16(tmp.data(), reinterpret_cast<uint16_t*>(q.data()) + w * stride, dim);
+                break;
+            case Vec::Type::I8:
+                qs[w] = Vec::toI8(tmp.data(), reinterpret_cast<int8_t*>(q.data()) + w * stride, dim);
+                break;
+        }
+    }
+    E.swap(e);
+    Q.swap(q);
+    Qs.swap(qs);
+    qt = t;
+}
+
+// Read-only view of the rows in their stored type
+Vec::Rows LM::view() const {
+    settle();
+    if (qt == Vec::Type::F32) return {row(0), stride, static_cast<size_t>(dim), qt, nullptr};
+    return {mm ? mq : Q.data(), stride, static_cast<size_t>(dim), qt, mm ? mqs : Qs.data()};
 }
 
 // Add a word with random initialization
-void LM::addWord(const std::string& word) {
-    if (embeddings.find(word) == embeddings.end()) {
-        embeddings[word] = std::vector<float>(dim);
-        for (auto& val : embeddings[word]) {
-            val = randomFloat();
+uint32_t LM::addWord(const std::string& word) {
+    if (stride == 0) reset(dim);
+    uint32_t known = id(word);
+    if (known != npos) return known;
+    writable();
+    own();
+    auto [it, added] = ids.try_emplace(word, static_cast<uint32_t>(rows));
+    if (added) {
+        words.push_back(word);
+        E.resize(++rows * stride, 0.0f); // Padding lanes stay zero
+        stamp.push_back(ep);
+        float* vec = row(it->second);
+        Rng::fill(vec, dim);
+        normalizeVector(vec);
+        if (ann.size() == it->second && ann.size() > 0) {
+            ann.add(it->second, view());
         }
-        normalizeVector(embeddings[word]);
     }
+    return it->second;
 }
 
 // Retrieve the embedding vector for a given word
-const std::vector<float>& LM::getEmbedding(const std::string& word) const {
-    if (embeddings.find(word) == embeddings.end()) {
+std::span<const float> LM::getEmbedding(const std::string& word) const {
+    uint32_t w = id(word);
+    if (w == npos) {
         throw std::runtime_error("Word not found in embeddings.");
     }
-    return embeddings.at(word);
+    return getEmbedding(w);
+}
+
+std::span<const float> LM::getEmbedding(uint32_t id) const {
+    if (qt != Vec::Type::F32) {
+        throw std::runtime_error("Model is quantized; use getEmbedding(id, out).");
+    }
+    settle(id);
+    return {row(id), static_cast<size_t>(dim)};
+}
+
+// Row id as f32, dequantized if needed
+void LM::getEmbedding(uint32_t id, float* out) const {
+    if (qt == Vec::Type::F32) {
+        settle(id);
+        std::copy(row(id), row(id) + dim, out);
+        return;
+    }
+    view().get(id, out);
 }
 
 // Update embeddings using a context-aware competitive learning algorithm
 void LM::updateWithContext(const std::vector<std::string>& contexts, const std::string& word, const std::string& contextWord, float coOccurrence) {
-    if (embeddings.find(word) == embeddings.end() || embeddings.find(contextWord) == embeddings.end()) {
+    uint32_t w = id(word), c = id(contextWord);
+    if (w == npos || c == npos) {
         return; // Skip updates for unknown words
     }
+    writable();
+    std::vector<uint32_t> ctx;
+    ctx.reserve(contexts.size());
+    for (const auto& s : contexts) {
+        uint32_t i = id(s);
+        if (i != npos) ctx.push_back(i);
+    }
+    if (ctx.size() == contexts.size()) {
+        updateWithContext(ctx.data(), ctx.size(), w, c, coOccurrence);
+        return;
+    }
+    // Unknown contexts still count towards the mean, as in getContextEmbedding
+    std::vector<float> pooled = getContextEmbedding(contexts);
+    plastic(pooled.data(), w, c, lr, reg);
+}
 
-    auto& wordVec = embeddings[word];
-    auto& contextVec = embeddings[contextWord];
-    std::vector<float> pooledContext = getContextEmbedding(contexts);
+// ID form: ctx, word and contextWord must be valid row IDs
+void LM::updateWithContext(const uint32_t* ctx, size_t n, uint32_t word, uint32_t contextWord, float coOccurrence) {
+    writable();
+    thread_local std::vector<float> pooled;
+    pooled.resize(dim);
+    getContextEmbedding(ctx, n, pooled.data());
+    plastic(pooled.data(), word, contextWord, lr, reg);
+}
 
-    for (int i = 0; i < dim; ++i) {
-        float gradient = (pooledContext[i] * wordVec[i] * contextVec[i]) - reg;
-        wordVec[i] += lr * gradient;
-        contextVec[i] += lr * gradient;
-    }
+// Hebbian step on rows word and contextWord driven by p, then noise and renormalization
+void LM::plastic(const float* p, uint32_t word, uint32_t contextWord, float rate, float decay) {
+    settle(word);
+    settle(contextWord);
+    float* wordVec = row(word);
+    float* contextVec = row(contextWord);
+    Vec::hebb(p, wordVec, contextVec, rate, decay, dim);
 
     addNoise(wordVec, noise);
     addNoise(contextVec, noise);
@@ -95,128 +515,550 @@ void LM::updateWithContext(const std::vector<std::string>& contexts, const std::
     normalizeVector(contextVec);
 }
 
+// One supervised pair: the context row drives the update, then the pair is scored on the result
+float LM::fit(uint32_t word, uint32_t contextWord, float label, float rate, float decay) {
+    writable();
+    thread_local std::vector<float> p;
+    p.resize(dim);
+    settle(contextWord);
+    std::memcpy(p.data(), row(contextWord), dim * sizeof(float)); // hebb writes the context row while reading p
+    plastic(p.data(), word, contextWord, rate, decay);
+    float d = Vec::dot(row(word), row(contextWord), dim) - label;
+    return d * d;
+}
+
+// Shrink every row by (1 - beta); rows trained again are renormalized, so only idle rows fade
+void LM::forget(float beta) {
+    writable();
+    settle();
+    // Every row shrinks by the same factor, so similarity rankings and the index links stay valid
+    float f = 1.0f - beta;
+    Pool pool(rows < 4096 ? 1 : threads);
+    pool.each(rows, [&](size_t b, size_t e, unsigned) {
+        for (size_t w = b; w < e; ++w) Vec::scale(row(static_cast<uint32_t>(w)), f, dim);
+    });
+}
+
+// Sum rows ctx[0..n) into out[dim]
+void LM::pool(const uint32_t* ctx, size_t n, float* out) const {
+    if (qt == Vec::Type::F32) {
+        for (size_t k = 0; k < n; ++k) settle(ctx[k]);
+        Vec::pool(row(0), stride, ctx, n, out, dim);
+        return;
+    }
+    Vec::Rows R = view();
+    std::fill(out, out + dim, 0.0f);
+    for (size_t k = 0; k < n; ++k) {
+        R.add(ctx[k], 1.0f, out);
+    }
+}
+
 // Pool embeddings for a set of contexts
 std::vector<float> LM::getContextEmbedding(const std::vector<std::string>& contexts) const {
     std::vector<float> pooled(dim, 0.0f);
-    for (const auto& ctx : contexts) {
-        if (embeddings.find(ctx) != embeddings.end()) {
-            for (int i = 0; i < dim; ++i) {
-                pooled[i] += embeddings.at(ctx)[i];
-            }
+    std::vector<uint32_t> ctx;
+    ctx.reserve(contexts.size());
+    for (const auto& s : contexts) {
+        uint32_t i = id(s);
+        if (i != npos) ctx.push_back(i);
+    }
+    if (contexts.empty()) return pooled;
+    pool(ctx.data(), ctx.size(), pooled.data());
+    Vec::scale(pooled.data(), 1.0f / contexts.size(), dim);
+    return pooled;
+}
+
+// Mean of rows ctx[0..n) into out[dim]; zeros when n == 0
+void LM::getContextEmbedding(const uint32_t* ctx, size_t n, float* out) const {
+    pool(ctx, n, out);
+    if (n > 0) Vec::scale(out, 1.0f / n, dim);
+}
+
+// Mean of each list ctx[offs[i], offs[i + 1]) into out + i * ld
+void LM::getContextEmbeddings(const uint32_t* ctx, const size_t* offs, size_t count, float* out, size_t ld) const {
+    for (size_t i = 0; i < count; ++i) {
+        getContextEmbedding(ctx + offs[i], offs[i + 1] - offs[i], out + i * ld);
+    }
+}
+
+// Resolve every list's words once, then gather-accumulate each list into out + i * ld
+void LM::getContextEmbeddings(const std::vector<std::vector<std::string>>& contexts, float* out, size_t ld) const {
+    thread_local std::vector<uint32_t> ctx;
+    ctx.clear();
+    for (size_t i = 0; i < contexts.size(); ++i) {
+        size_t b = ctx.size();
+        for (const auto& s : contexts[i]) {
+            uint32_t w = id(s);
+            if (w != npos) ctx.push_back(w);
         }
+        float* o = out + i * ld;
+        pool(ctx.data() + b, ctx.size() - b, o);
+        if (!contexts[i].empty()) Vec::scale(o, 1.0f / contexts[i].size(), dim);
     }
-    for (float& val : pooled) {
-        val /= contexts.size();
+}
+
+// Nearest rows to vec by index search, after indexing any rows added since the last call
+std::vector<std::pair<uint32_t, float>> LM::nearest(std::span<const float> vec, size_t k) const {
+    if (vec.size() != static_cast<size_t>(dim)) {
+        throw std::runtime_error("Embedding dimension mismatch.");
+    }
+    thread_local std::vector<float> q;
+    q.assign(vec.begin(), vec.end());
+    Vec::normalize(q.data(), q.size());
+    Vec::Rows R = view();
+    std::shared_lock<std::shared_mutex> lk(*annLock);
+    if (ann.size() < rows) {
+        lk.unlock();
+        index();
+        lk.lock();
+    }
+    std::vector<std::pair<uint32_t, float>> hits;
+    for (const auto& [w, d] : ann.search(q.data(), k, R)) {
+        hits.emplace_back(w, 1.0f - d);
+    }
+    return hits;
+}
+
+std::vector<std::pair<uint32_t, float>> LM::nearest(const std::string& word, size_t k) const {
+    uint32_t w = id(word);
+    if (w == npos) {
+        throw std::runtime_error("Word not found in embeddings.");
+    }
+    std::vector<float> vec(dim);
+    getEmbedding(w, vec.data());
+    auto hits = nearest(vec, k + 1);
+    std::erase_if(hits, [w](const auto& h) { return h.first == w; });
+    if (hits.size() > k) hits.resize(k);
+    return hits;
+}
+
+// Build or extend the nearest-neighbour index over all rows
+void LM::index() const {
+    std::unique_lock<std::shared_mutex> lk(*annLock);
+    if (ann.size() == rows) return;
+    Vec::Rows R = view();
+    for (uint32_t w = ann.size(); w < rows; ++w) {
+        ann.add(w, R);
+    }
+}
+
+uint64_t LM::fingerprint(size_t n) const {
+    uint64_t h = fnv1a(std::to_string(dim) + ':' + std::to_string(n));
+    for (uint32_t w = 0; w < n; ++w) {
+        h = (h ^ fnv1a(word(w))) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Save whatever is indexed; with nothing indexed a stale file is removed so loadIndex cannot pick it up
+void LM::saveIndex(const std::string& path) const {
+    std::shared_lock<std::shared_mutex> lk(*annLock);
+    if (ann.size() == 0) {
+        std::remove(path.c_str());
+        return;
+    }
+    ann.save(path, fingerprint(ann.size()));
+}
+
+// Load an index saved with this model; a mismatched index is dropped and rebuilt by index()
+void LM::loadIndex(const std::string& path) {
+    uint64_t tag = ann.load(path);
+    if (ann.size() > rows || tag != fingerprint(ann.size())) {
+        ann.clear();
+        throw std::runtime_error("Index does not match model.");
     }
-    return pooled;
 }
 
-// Competitive update for embeddings
+// Competitive update for embeddings: O(1) here, rows catch up when next touched
 void LM::competitiveUpdate() {
-    for (auto& [word, vec] : embeddings) {
-        float maxVal = *std::max_element(vec.begin(), vec.end());
-        for (float& val : vec) {
-            val = (val == maxVal) ? val + lr : val * (1.0f - reg);
+    writable();
+    if (ep == UINT32_MAX >> 1) {
+        // The next count would reach the busy bit: bring every row up to date and restart from 0
+        settle();
+        ep = 0;
+        std::fill(stamp.begin(), stamp.end(), 0u);
+        flat = 0;
+    }
+    ++ep;
+}
+
+// Apply k competitive updates to one row. Each update raises the max coordinate(s) by lr, shrinks the
+// rest by (1 - reg) and renormalizes. While the max stays the max, the rest only changes by a common
+// factor, so consecutive updates reduce to a scalar recurrence plus one pass over the row; an update
+// that would change the max is applied directly.
+void LM::decay(float* vec, uint32_t k) const {
+    const double r = 1.0 - reg;
+    while (k > 0) {
+        float m = *std::max_element(vec, vec + dim);
+        size_t t = 0;        // Coordinates at the max
+        float b = -INFINITY; // Largest of the rest
+        double rest2 = 0.0;  // Squared norm of the rest
+        for (int i = 0; i < dim; ++i) {
+            if (vec[i] == m) {
+                ++t;
+            } else {
+                rest2 += double(vec[i]) * vec[i];
+                b = std::max(b, vec[i]);
+            }
+        }
+        double a = m, s = 1.0; // Max coordinate and rest scale after j updates
+        uint32_t j = 0;
+        for (; j < k && r * b * s < a + lr; ++j) {
+            double ya = a + lr;
+            double n = std::sqrt(t * ya * ya + r * r * s * s * rest2);
+            if (n == 0.0) n = 1.0; // As normalizeVector: the zero vector stays put
+            a = ya / n;
+            s = s * r / n;
+        }
+        if (j == 0) { // The max changes: one update as written
+            for (int i = 0; i < dim; ++i) {
+                vec[i] = (vec[i] == m) ? vec[i] + lr : vec[i] * (1.0f - reg);
+            }
+            Vec::normalize(vec, dim);
+            --k;
+            continue;
+        }
+        for (int i = 0; i < dim; ++i) {
+            vec[i] = (vec[i] == m) ? static_cast<float>(a) : static_cast<float>(vec[i] * s);
+        }
+        k -= j;
+    }
+}
+
+// Bring row id up to date. Rows are settled at most once per update: the thread that sets the busy
+// bit applies the pending updates, others wait for it.
+void LM::settle(uint32_t id) const {
+    constexpr uint32_t busy = 1u << 31;
+    std::atomic_ref<uint32_t> st(stamp[id]);
+    uint32_t have = st.load(std::memory_order_acquire);
+    while (have != ep) {
+        if (have & busy) {
+            std::this_thread::yield();
+            have = st.load(std::memory_order_acquire);
+        } else if (st.compare_exchange_weak(have, have | busy, std::memory_order_acquire)) {
+            decay(const_cast<float*>(row(id)), ep - have);
+            st.store(ep, std::memory_order_release);
+            return;
         }
-        normalizeVector(vec);
     }
 }
 
+// Bring every row up to date (before reads that scan rows: views, saves, the index)
+void LM::settle() const {
+    std::atomic_ref<uint32_t> f(flat);
+    if (f.load(std::memory_order_acquire) == ep) return;
+    Pool pool(rows < 4096 ? 1 : threads);
+    pool.each(rows, [&](size_t b, size_t e, unsigned) {
+        for (size_t w = b; w < e; ++w) settle(static_cast<uint32_t>(w));
+    });
+    f.store(ep, std::memory_order_release);
+}
+
 // Train embeddings for a given co-occurrence dataset
 void LM::train(const CoOccurrenceData& data, size_t epochs) {
+    writable();
+
+    // Resolve words to row IDs once; pairs with unknown words are skipped as before
+    std::vector<std::tuple<uint32_t, uint32_t, float>> pairs;
+    pairs.reserve(data.size());
+    for (const auto& [word, contextWord, coOccurrence] : data) {
+        uint32_t w = id(word), c = id(contextWord);
+        if (w != npos && c != npos) pairs.emplace_back(w, c, coOccurrence);
+    }
+
+    ann.clear(); // Rows move during training; the next nearest() rebuilds
+
+    // Hogwild: workers update shared rows without locks. Collisions on a row are rare for
+    // sparse co-occurrence data and only perturb the update, like the noise added anyway.
+    Pool pool(threads);
+    pool.run([](unsigned t) { Rng::stream(t); }); // Worker t draws noise from stream t (reproducible with a fixed seed)
     for (size_t epoch = 0; epoch < epochs; ++epoch) {
-        for (const auto& [word, contextWord, coOccurrence] : data) {
-            updateWithContext({contextWord}, word, contextWord, coOccurrence);
-        }
-        competitiveUpdate();
-        std::cout << "Epoch " << epoch + 1 << "/" << epochs << " complete." << std::endl;
+        auto t0 = std::chrono::steady_clock::now();
+        pool.each(pairs.size(), [&](size_t b, size_t e, unsigned) {
+            for (size_t i = b; i < e; ++i) {
+                const auto& [w, c, coOccurrence] = pairs[i];
+                updateWithContext(&c, 1, w, c, coOccurrence);
+            }
+        });
+        competitiveUpdate(); // Lazy: only rows touched again pay for it
+        std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+        std::cout << "Epoch " << epoch + 1 << "/" << epochs << " complete. "
+                  << static_cast<size_t>(pairs.size() / std::max(dt.count(), 1e-9)) << " pairs/s ("
+                  << pool.size() << " threads)." << std::endl;
     }
 }
 
-// Save embeddings to a JSON file
+// Save embeddings to a JSON file, formatted with to_chars into a large buffer
 void LM::save(const std::string& path) const {
-    std::ofstream file(path);
+    std::ofstream file(path, std::ios::binary);
     if (!file.is_open()) {
         throw std::runtime_error("Failed to open file for saving embeddings.");
     }
 
-    file << "{\n";
-    bool firstWord = true;
-    for (const auto& [word, vec] : embeddings) {
-        if (!firstWord) {
-            file << ",\n";
+    auto t0 = std::chrono::steady_clock::now();
+    constexpr size_t flushAt = 1 << 20;
+    std::string buf;
+    buf.reserve(flushAt + 64 * (dim + 1));
+    std::vector<float> vec(dim);
+    char num[32];
+    buf += "{\n";
+    for (uint32_t w = 0; w < rows; ++w) {
+        if (w > 0) buf += ",\n";
+        getEmbedding(w, vec.data());
+        buf += "  \"";
+        jsonEscape(buf, word(w));
+        buf += "\": [";
+        for (int i = 0; i < dim; ++i) {
+            if (i > 0) buf += ", ";
+            buf.append(num, std::to_chars(num, num + sizeof(num), vec[i]).ptr); // Shortest round-trip form
         }
-        firstWord = false;
-
-        file << "  \"" << word << "\": [";
-        for (size_t i = 0; i < vec.size(); ++i) {
-            file << vec[i];
-            if (i < vec.size() - 1) {
-                file << ", ";
-            }
+        buf += ']';
+        if (buf.size() >= flushAt) {
+            file.write(buf.data(), buf.size());
+            buf.clear();
         }
-        file << "]";
     }
-    file << "\n}\n";
+    buf += "\n}\n";
+    file.write(buf.data(), buf.size());
+    file.close();
+    if (!file) {
+        throw std::runtime_error("Failed to write embeddings.");
+    }
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    std::cout << "Saved " << rows << " embeddings. "
+              << static_cast<size_t>(rows / std::max(dt.count(), 1e-9)) << " rows/s." << std::endl;
 }
 
-// Load embeddings from a JSON file
+// Load embeddings from a JSON file. Large files are split at record boundaries and parsed by
+// `threads` workers; records are then inserted in file order, so duplicate words keep the last vector.
 void LM::load(const std::string& path) {
-    std::ifstream file(path);
-    if (!file.is_open()) {
-        throw std::runtime_error("Failed to open file for loading embeddings.");
-    }
-
-    embeddings.clear();
-    std::string line, word;
-    while (std::getline(file, line)) {
-        size_t keyStart = line.find("\"");
-        if (keyStart == std::string::npos) continue;
-        size_t keyEnd = line.find("\"", keyStart + 1);
-        word = line.substr(keyStart + 1, keyEnd - keyStart - 1);
-
-        size_t vecStart = line.find("[");
-        size_t vecEnd = line.find("]");
-        if (vecStart == std::string::npos || vecEnd == std::string::npos) continue;
-
-        std::string vecContent = line.substr(vecStart + 1, vecEnd - vecStart - 1);
-        std::istringstream stream(vecContent);
-        std::vector<float> vec;
-        float value;
-        while (stream >> value) {
-            vec.push_back(value);
-            if (stream.peek() == ',') {
-                stream.ignore();
-            }
+    auto t0 = std::chrono::steady_clock::now();
+    MMap m(path);
+    const char* b = m.data();
+    const char* e = b + m.size();
+
+    JsonReader head{b, b, e};
+    head.ws();
+    reset(dim);
+    if (head.p == e) return; // Empty file: empty vocabulary
+    head.expect('{');
+
+    Pool pool(m.size() < (16u << 20) ? 1 : threads);
+    unsigned n = pool.size();
+    std::vector<const char*> cut(n + 1, e);
+    cut[0] = head.p;
+    for (unsigned t = 1; t < n; ++t) {
+        cut[t] = std::max(cut[t - 1], recordStart(head.p + (e - head.p) * t / n, e));
+    }
+    std::vector<Records> parts(n);
+    pool.run([&](unsigned t) {
+        JsonReader in{b, cut[t], e};
+        in.records(cut[t + 1], t + 1 == n, parts[t]);
+    });
+
+    size_t total = 0;
+    for (const auto& r : parts) total += r.words.size();
+    ids.reserve(total);
+    words.reserve(total);
+    for (auto& r : parts) {
+        if (!r.words.empty() && rows == 0) reset(static_cast<int>(r.offs[1])); // Dimension of the first record
+        E.reserve(total * stride);
+        for (size_t i = 0; i < r.words.size(); ++i) {
+            set(r.words[i], r.vals.data() + r.offs[i], r.offs[i + 1] - r.offs[i]);
         }
-        embeddings[word] = vec;
+        r = Records{};
     }
+
+    std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+    std::cout << "Loaded " << rows << " embeddings. "
+              << static_cast<size_t>(rows / std::max(dt.count(), 1e-9)) << " rows/s (" << n << " threads)." << std::endl;
 }
 
-// Serialize embeddings to a binary string
-std::string LM::serialize() const {
-    std::ostringstream oss(std::ios::binary);
-    int version = 1;
-    oss.write(reinterpret_cast<const char*>(&version), sizeof(version));
+// Write the binary model format (see LM.h) with rows stored as t
+void LM::emit(std::ostream& out, Vec::Type t) const {
+    uint64_t hsize = 16;
+    while (hsize < 2 * rows) hsize <<= 1;
+    std::vector<uint32_t> hash(hsize, 0);
+    std::vector<uint64_t> offs(rows + 1, 0);
+    for (uint32_t w = 0; w < rows; ++w) {
+        std::string_view s = word(w);
+        offs[w + 1] = offs[w] + s.size();
+        uint64_t h = fnv1a(s) & (hsize - 1);
+        while (hash[h] != 0) h = (h + 1) & (hsize - 1);
+        hash[h] = w + 1;
+    }
 
-    size_t mapSize = embeddings.size();
-    oss.write(reinterpret_cast<const char*>(&mapSize), sizeof(mapSize));
+    size_t width = Vec::width(t);
+    uint64_t matOff = HDR;
+    uint64_t matEnd = matOff + rows * stride * width;
+    uint64_t scaleOff = t == Vec::Type::I8 ? (matEnd + 7) & ~uint64_t(7) : 0;
+    uint64_t strOff = t == Vec::Type::I8 ? scaleOff + rows * 4 : (matEnd + 7) & ~uint64_t(7);
+    uint64_t hashOff = (strOff + (rows + 1) * 8 + offs[rows] + 7) & ~uint64_t(7);
+    uint64_t fileSize = hashOff + hsize * 4;
 
-    for (const auto& [word, vec] : embeddings) {
-        size_t wordLen = word.size();
-        oss.write(reinterpret_cast<const char*>(&wordLen), sizeof(wordLen));
-        oss.write(word.data(), wordLen);
+    char hdr[HDR] = {};
+    std::memcpy(hdr, "XILM", 4);
+    put32(hdr + 4, 2);
+    put32(hdr + 8, 0x01020304u);
+    put32(hdr + 12, static_cast<uint32_t>(dim));
+    put32(hdr + 16, static_cast<uint32_t>(stride));
+    put32(hdr + 20, static_cast<uint32_t>(t));
+    put64(hdr + 24, rows);
+    put64(hdr + 32, matOff);
+    put64(hdr + 40, strOff);
+    put64(hdr + 48, hashOff);
+    put64(hdr + 56, hsize);
+    put64(hdr + 64, fileSize);
+    put64(hdr + 72, scaleOff);
+    out.write(hdr, HDR);
 
-        size_t vecSize = vec.size();
-        oss.write(reinterpret_cast<const char*>(&vecSize), sizeof(vecSize));
-        oss.write(reinterpret_cast<const char*>(vec.data()), vecSize * sizeof(float));
+    // Rows already stored as t are copied as-is; anything else goes through f32
+    Vec::Rows R = view();
+    std::vector<float> vec(stride, 0.0f), scales;
+    std::vector<uint16_t> half(stride, 0);
+    std::vector<char> buf(stride * width, 0);
+    for (uint32_t w = 0; w < rows; ++w) {
+        const char* raw = static_cast<const char*>(R.base) + w * stride * width;
+        if (t != qt) R.get(w, vec.data());
+        switch (t) {
+            case Vec::Type::F32:
+                if (t == qt) std::memcpy(vec.data(), raw, buf.size());
+                for (size_t i = 0; i < stride; ++i) {
+                    uint32_t bits;
+                    std::memcpy(&bits, &vec[i], 4);
+                    put32(&buf[i * 4], bits);
+                }
+                break;
+            case Vec::Type::F16:
+                if (t == qt) std::memcpy(half.data(), raw, buf.size());
+                else Vec::toF16(vec.data(), half.data(), dim);
+                for (size_t i = 0; i < stride; ++i) {
+                    buf[i * 2] = static_cast<char>(half[i]);
+                    buf[i * 2 + 1] = static_cast<char>(half[i] >> 8);
+                }
+                break;
+            case Vec::Type::I8:
+                if (t == qt) {
+                    std::memcpy(buf.data(), raw, buf.size());
+                    scales.push_back(R.scale[w]);
+                } else {
+                    scales.push_back(Vec::toI8(vec.data(), reinterpret_cast<int8_t*>(buf.data()), dim));
+                }
+                break;
+        }
+        out.write(buf.data(), buf.size());
+    }
+
+    char b8[8];
+    const char zero[8] = {};
+    if (t == Vec::Type::I8) {
+        out.write(zero, scaleOff - matEnd);
+        for (float f : scales) {
+            uint32_t bits;
+            std::memcpy(&bits, &f, 4);
+            put32(b8, bits);
+            out.write(b8, 4);
+        }
+    } else {
+        out.write(zero, strOff - matEnd);
+    }
+    for (uint64_t o : offs) {
+        put64(b8, o);
+        out.write(b8, 8);
+    }
+    for (uint32_t w = 0; w < rows; ++w) {
+        std::string_view s = word(w);
+        out.write(s.data(), s.size());
+    }
+    out.write(zero, hashOff - (strOff + (rows + 1) * 8 + offs[rows])); // Pad to 8 bytes
+    for (uint32_t h : hash) {
+        put32(b8, h);
+        out.write(b8, 4);
     }
+}
 
+// Serialize embeddings to a binary string
+std::string LM::serialize(Vec::Type t) const {
+    std::ostringstream oss(std::ios::binary);
+    emit(oss, t);
     return oss.str();
 }
 
-// Deserialize embeddings from a binary string
+// Write via a temporary file and rename, so a model mapped from path stays valid
+void LM::write(const std::string& path, Vec::Type t) const {
+    std::string tmp = path + ".tmp";
+    std::ofstream file(tmp, std::ios::binary);
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file for saving model.");
+    }
+    emit(file, t);
+    file.close();
+    if (!file || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("Failed to write model.");
+    }
+}
+
+// Serve a model file in place: rows and vocabulary are read straight from the mapping
+void LM::map(const std::string& path) {
+    auto m = std::make_shared<MMap>(path, true);
+    Hdr h = header(m->data(), m->size());
+    if (std::endian::native != std::endian::little) {
+        deserialize(std::string(m->data(), m->size())); // Fields need swapping: copy instead
+        return;
+    }
+    reset(static_cast<int>(h.dim));
+    stride = h.stride;
+    rows = h.rows;
+    stamp.assign(rows, ep);
+    mm = std::move(m);
+    qt = static_cast<Vec::Type>(h.dtype);
+    if (qt == Vec::Type::F32) {
+        mrows = reinterpret_cast<float*>(mm->data() + h.matOff);
+    } else {
+        mq = mm->data() + h.matOff;
+        if (qt == Vec::Type::I8) mqs = reinterpret_cast<const float*>(mm->data() + h.scaleOff);
+    }
+    soff = reinterpret_cast<const uint64_t*>(mm->data() + h.strOff);
+    sbuf = mm->data() + h.strOff + (h.rows + 1) * 8;
+    htab = reinterpret_cast<const uint32_t*>(mm->data() + h.hashOff);
+    hmask = h.hashSize - 1;
+}
+
+// Deserialize embeddings from a binary string (format v2, or the legacy host-endian v1)
 void LM::deserialize(const std::string& data) {
+    if (data.compare(0, 4, "XILM") == 0) {
+        Hdr h = header(data.data(), data.size());
+        reset(static_cast<int>(h.dim));
+        const char* offs = data.data() + h.strOff;
+        const char* strs = offs + (h.rows + 1) * 8;
+        Vec::Type t = static_cast<Vec::Type>(h.dtype);
+        size_t width = Vec::width(t);
+        std::vector<float> vec(h.dim);
+        for (uint64_t w = 0; w < h.rows; ++w) {
+            const char* r = data.data() + h.matOff + w * h.stride * width;
+            for (uint32_t i = 0; i < h.dim; ++i) {
+                if (t == Vec::Type::F32) {
+                    uint32_t bits = le32(r + i * 4);
+                    std::memcpy(&vec[i], &bits, 4);
+                } else if (t == Vec::Type::F16) {
+                    uint16_t bits = static_cast<uint16_t>(static_cast<unsigned char>(r[i * 2]) |
+                                                          (static_cast<unsigned char>(r[i * 2 + 1]) << 8));
+                    Vec::fromF16(&bits, &vec[i], 1);
+                } else {
+                    uint32_t bits = le32(data.data() + h.scaleOff + w * 4);
+                    float sc;
+                    std::memcpy(&sc, &bits, 4);
+                    vec[i] = static_cast<int8_t>(r[i]) * sc;
+                }
+            }
+            uint64_t b = le64(offs + w * 8), e = le64(offs + (w + 1) * 8);
+            set(std::string(strs + b, e - b), vec.data(), vec.size());
+        }
+        quantize(t); // Keep quantized files quantized
+        return;
+    }
+
     std::istringstream iss(data, std::ios::binary);
     int version;
     iss.read(reinterpret_cast<char*>(&version), sizeof(version));
@@ -227,7 +1069,7 @@ void LM::deserialize(const std::string& data) {
     size_t mapSize;
     iss.read(reinterpret_cast<char*>(&mapSize), sizeof(mapSize));
 
-    embeddings.clear();
+    reset(dim);
     for (size_t i = 0; i < mapSize; ++i) {
         size_t wordLen;
         iss.read(reinterpret_cast<char*>(&wordLen), sizeof(wordLen));
@@ -239,16 +1081,10 @@ void LM::deserialize(const std::string& data) {
         std::vector<float> vec(vecSize);
         iss.read(reinterpret_cast<char*>(vec.data()), vecSize * sizeof(float));
 
-        embeddings[word] = vec;
+        set(word, vec.data(), vec.size());
     }
 
     if (iss.fail()) {
         throw std::runtime_error("Failed to deserialize model.");
     }
 }
-
-
-
-
-
-
@@ -2,49 +2,155 @@
 #define LM_H
 
 #include <string>
+#include <ostream>
 #include <vector>
 #include <unordered_map>
 #include <tuple>
+#include <span>
+#include <string_view>
+#include <memory>
+#include <shared_mutex>
+#include <cstdint>
+#include "utils.h"
+#include "HNSW.h"
 
 using CoOccurrenceData = std::vector<std::tuple<std::string, std::string, float>>;
 
 class LM {
 private:
-    std::unordered_map<std::string, std::vector<float>> embeddings; // Word embeddings
+    std::unordered_map<std::string, uint32_t> ids; // Vocabulary: word -> row ID
+    std::vector<std::string> words;                // Vocabulary: row ID -> word
+    std::vector<float, AlignedAlloc<float>> E;     // Embedding slab, row-major, stride floats per row
+    size_t stride = 0;                             // Row pitch: dim rounded up to 8 floats (32 bytes)
+    size_t rows = 0;                               // Vocabulary size
+    Vec::Type qt = Vec::Type::F32;                 // Row type; quantized rows are read-only (writes dequantize)
+    std::vector<char, AlignedAlloc<char>> Q;       // Quantized rows, stride elements per row
+    std::vector<float> Qs;                         // Per-row scales for I8 rows
+
+    // Mapped model (see map()): vocabulary and rows are served from the file instead of ids/words/E
+    std::shared_ptr<MMap> mm;                      // Private copy-on-write mapping; training writes stay in memory
+    float* mrows = nullptr;                        // Mapped matrix (F32)
+    const char* mq = nullptr;                      // Mapped matrix (F16 / I8)
+    const float* mqs = nullptr;                    // Mapped per-row scales (I8)
+    const uint64_t* soff = nullptr;                // Mapped string table offsets [rows + 1]
+    const char* sbuf = nullptr;                    // Mapped string bytes
+    const uint32_t* htab = nullptr;                // Mapped open-addressing hash of words: row ID + 1, 0 = empty
+    uint64_t hmask = 0;                            // Hash table size - 1
+    mutable HNSW ann;                              // Nearest-neighbour index over rows [0, ann.size())
+    std::unique_ptr<std::shared_mutex> annLock = std::make_unique<std::shared_mutex>(); // Lets nearest() extend ann
+
+    // Lazy competitive updates: competitiveUpdate() only bumps ep; a row catches up on the updates it
+    // missed (stamp[id] < ep) when it is next read or written. Settling writes through const methods;
+    // a busy bit in the stamp makes concurrent readers wait instead of applying an update twice.
+    uint32_t ep = 0;                               // Competitive updates issued
+    mutable std::vector<uint32_t> stamp;           // Per row: updates applied (top bit = settling)
+    mutable uint32_t flat = 0;                     // Every row is settled up to this update
+
     // Helper functions for internal use
-    float randomFloat();
-    void normalizeVector(std::vector<float>& vec);
-    void addNoise(std::vector<float>& vec, float factor);
+    void normalizeVector(float* vec);
+    void addNoise(float* vec, float factor);
+    void reset(int d); // Clear vocabulary and set dimensionality
+    uint32_t set(const std::string& word, const float* vec, size_t n); // Insert or overwrite a row
+    void pool(const uint32_t* ctx, size_t n, float* out) const; // Sum rows ctx[0..n) into out
+    void decay(float* vec, uint32_t k) const; // Apply k competitive updates to one row
+    void settle(uint32_t id) const; // Apply updates row id missed
+    void settle() const;            // Apply updates every row missed
+    void plastic(const float* p, uint32_t word, uint32_t contextWord, float rate, float decay); // Hebbian pair update
+    void own(); // Copy a mapped model into owned storage before the vocabulary changes
+    void emit(std::ostream& out, Vec::Type t) const; // Write the binary model format with rows as t
+    uint64_t fingerprint(size_t n) const; // Identifies rows [0, n) for a saved index: dim and their words
+    void writable() { if (qt != Vec::Type::F32) quantize(Vec::Type::F32); } // Dequantize before updates
+    float* row(uint32_t id) { return (mm ? mrows : E.data()) + id * stride; }
+    const float* row(uint32_t id) const { return (mm ? mrows : E.data()) + id * stride; }
 public:
     int dim=50;               // Dimensionality of embeddings
     float lr=0.01;             // Learning rate for updates
     float reg=0.001;           // Regularization factor for training
     float noise=0.01;              // Noise factor for stochastic updates
+    unsigned threads=1;        // Training worker threads (0 = all cores)
+
+    static constexpr uint32_t npos = UINT32_MAX; // Returned by id() for unknown words
 
     // Constructor
     LM(int dim, float lr, float reg, float noise);
 
+    // Vocabulary
+    uint32_t id(const std::string& word) const; // Row ID for a word, npos if unknown
+    std::string_view word(uint32_t id) const;
+    size_t size() const { return rows; }
+
     // Methods for managing words and embeddings
-    void addWord(const std::string& word);
-    const std::vector<float>& getEmbedding(const std::string& word) const;
+    uint32_t addWord(const std::string& word); // Returns the word's row ID
+    std::span<const float> getEmbedding(const std::string& word) const;
+    std::span<const float> getEmbedding(uint32_t id) const; // F32 rows only
+    void getEmbedding(uint32_t id, float* out) const;       // Any row type, dequantized into out[dim]
 
     // Context-aware embedding updates
     void updateWithContext(const std::vector<std::string>& contexts,
                            const std::string& word,
                            const std::string& contextWord,
                            float coOccurrence);
+    void updateWithContext(const uint32_t* ctx, size_t n, uint32_t word, uint32_t contextWord, float coOccurrence);
 
     std::vector<float> getContextEmbedding(const std::vector<std::string>& contexts) const;
-
-    // Competitive learning updates
+    void getContextEmbedding(const uint32_t* ctx, size_t n, float* out) const; // Mean of rows into out[dim]
+
+    /**
+     * @brief Pool many context lists at once into a caller-provided matrix (no allocation per query).
+     * @param ctx Row IDs of all lists back to back; list i is ctx[offs[i], offs[i + 1]).
+     * @param offs count + 1 offsets into ctx.
+     * @param out Output rows of ld floats (ld >= dim); row i receives the mean of list i.
+     * Empty lists give a zero row.
+     */
+    void getContextEmbeddings(const uint32_t* ctx, const size_t* offs, size_t count, float* out, size_t ld) const;
+    // Word form: words are resolved once; unknown words count towards the mean as zero rows
+    void getContextEmbeddings(const std::vector<std::vector<std::string>>& contexts, float* out, size_t ld) const;
+
+    // Nearest neighbours: (row ID, similarity), most similar first. Similarity is the dot product with the
+    // normalized query: cosine for unit rows, scaled down for rows faded by competitive updates or forget().
+    // The first call after rows were added or the index dropped extends the index; calls may run concurrently.
+    std::vector<std::pair<uint32_t, float>> nearest(std::span<const float> vec, size_t k) const;
+    std::vector<std::pair<uint32_t, float>> nearest(const std::string& word, size_t k) const; // Excludes word
+    void index() const; // Build or extend the index over all rows
+    void saveIndex(const std::string& path) const; // Removes a file at path when nothing is indexed
+    void loadIndex(const std::string& path);
+
+    // Competitive learning update of every row (applied lazily, see stamp)
     void competitiveUpdate();
 
     // Training
     void train(const std::vector<std::tuple<std::string, std::string, float>>& coOccurrenceData, size_t epochs);
 
-    // Serialization and deserialization
-    std::string serialize() const;
-    void deserialize(const std::string& data);
+    /**
+     * @brief Hebbian update of a (word, context) pair driven by the context row, at the given rate and
+     * decay instead of lr and reg. Safe to call from several threads at once (Hogwild, as in train()).
+     * @return Squared error between the updated rows' dot product and label.
+     */
+    float fit(uint32_t word, uint32_t contextWord, float label, float rate, float decay);
+    void forget(float beta); // Scale every row by (1 - beta); the index stays valid
+
+    // Quantized storage: F16, or I8 with a per-row scale. Lookups and pooling run on the quantized
+    // rows directly; anything that writes rows (training, addWord) dequantizes to F32 first.
+    void quantize(Vec::Type t);
+    Vec::Type type() const { return qt; }
+    Vec::Rows view() const; // Read-only view of the rows in their stored type
+
+    // Serialization and deserialization (binary model format v2; deserialize also reads v1)
+    std::string serialize(Vec::Type t = Vec::Type::F32) const; // Rows quantized to t on the way out
+    void deserialize(const std::string& data);                 // Quantized files stay quantized
+
+    /**
+     * Binary model format v2, all fields little-endian with explicit widths:
+     *   header (128 bytes): "XILM", u32 version, u32 0x01020304, u32 dim, u32 stride, u32 dtype,
+     *                       u64 rows, u64 matOff, u64 strOff, u64 hashOff, u64 hashSize, u64 fileSize,
+     *                       u64 scaleOff
+     *   matrix at matOff (64-byte aligned): rows x stride elements of dtype (Vec::Type), padding zero
+     *   scales at scaleOff (I8 only): f32[rows]
+     *   strings at strOff: u64 offsets[rows + 1], then UTF-8 bytes
+     *   hash at hashOff: u32 slots[hashSize] (FNV-1a, linear probing), row ID + 1, 0 = empty
+     */
+    void write(const std::string& path, Vec::Type t = Vec::Type::F32) const; // Write the model file
+    void map(const std::string& path);         // Serve a model file in place via mmap (no parsing or copying)
 
     // File I/O for embeddings
     void save(const std::string& path) const;
@@ -52,8 +158,3 @@ public:
 };
 
 #endif // LM_H
-
-
-
-
-
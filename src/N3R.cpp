@@ -3,97 +3,792 @@
 #include <cmath>
 #include <stdexcept>
 #include <random>
-#include <unordered_set>
+#include <filesystem>
+#include <fstream>
+#include <bit>
+#include <zlib.h>
+#include <condition_variable>
+#include <mutex>
 #include "utils.h"
+#include "rng.h"
+
+namespace {
+    constexpr size_t SNAP_HDR = 64;
+
+    uint32_t crc(uint32_t c, const char* p, size_t n) {
+        while (n > 0) {
+            uInt k = static_cast<uInt>(std::min<size_t>(n, 1u << 30));
+            c = static_cast<uint32_t>(crc32(c, reinterpret_cast<const Bytef*>(p), k));
+            p += k;
+            n -= k;
+        }
+        return c;
+    }
+
+    template <typename T> T swapLE(T v) {
+        if constexpr (std::endian::native == std::endian::little || sizeof(T) == 1) {
+            return v;
+        } else {
+            char b[sizeof(T)];
+            std::memcpy(b, &v, sizeof(T));
+            std::reverse(b, b + sizeof(T));
+            std::memcpy(&v, b, sizeof(T));
+            return v;
+        }
+    }
+
+    // Write n values little-endian, folding the bytes into the running CRC
+    template <typename T> void put(std::ostream& out, const T* p, size_t n, uint32_t& c) {
+        if constexpr (std::endian::native == std::endian::little) {
+            out.write(reinterpret_cast<const char*>(p), n * sizeof(T));
+            c = crc(c, reinterpret_cast<const char*>(p), n * sizeof(T));
+        } else {
+            for (size_t i = 0; i < n; ++i) {
+                T v = swapLE(p[i]);
+                out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+                c = crc(c, reinterpret_cast<const char*>(&v), sizeof(T));
+            }
+        }
+    }
+
+    // Little-endian value at p
+    template <typename T> T get(const char* p) {
+        T v;
+        std::memcpy(&v, p, sizeof(T));
+        return swapLE(v);
+    }
+
+    // Hash of a (source, destination) pair: splitmix64's finalizer
+    uint64_t pairHash(uint32_t s, uint32_t d) {
+        uint64_t h = uint64_t(s) << 32 | d;
+        h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+        h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+        return h ^ (h >> 31);
+    }
+
+    // Empty a hash table column and size it for n entries (at most a quarter full, so n more fit before growing)
+    void resetTable(Col<uint32_t>& t, size_t n) {
+        t.clear();
+        t.resize(std::bit_ceil(std::max<size_t>(64, 4 * n)), 0);
+    }
+}
 
 namespace N3R {
+    NType parseType(const std::string& type) {
+        if (type == "input") return NType::Input;
+        if (type == "hidden") return NType::Hidden;
+        if (type == "output") return NType::Output;
+        throw std::runtime_error("Error: Invalid node type.");
+    }
+
+    const char* typeName(NType type) {
+        switch (type) {
+            case NType::Input: return "input";
+            case NType::Hidden: return "hidden";
+            case NType::Output: return "output";
+        }
+        return "?";
+    }
+
     // Add a node to the network
-    void NNet::addN(const std::string& id, const std::string& type, float value) {
-        if (nodes.count(id)) throw std::runtime_error("Error: Duplicate node ID.");
-        nodes[id] = Node{id, type, value};
+    uint32_t NNet::addN(const std::string& id, const std::string& type, float value) {
+        return addN(id, parseType(type), value);
+    }
+
+    uint32_t NNet::addN(const std::string& id, NType type, float value) {
+        auto w = write();
+        if (uint32_t v = this->id(id); v != npos) return v;
+        uint32_t n = static_cast<uint32_t>(types.size());
+        text.append(id.data(), id.size());
+        noff.push_back(text.size());
+        types.push_back(type);
+        vals.push_back(value); // Last: a node is complete once its value is stored (see open())
+        hashNode(n);
+        ord.push_back(static_cast<uint32_t>(at.size())); // New nodes go last
+        at.push_back(ord.back());
+        outHead.push_back(npos);
+        inHead.push_back(npos);
+        seen.push_back(0);
+        touch(n);
+        dirty = true;
+        return n;
+    }
+
+    uint32_t NNet::id(std::string_view node) const {
+        return nhash.empty() ? npos : nslot(node) - 1; // An empty slot gives npos
+    }
+
+    uint32_t& NNet::nslot(std::string_view id) const {
+        size_t mask = nhash.size() - 1;
+        for (size_t i = fnv1a(id) & mask;; i = (i + 1) & mask) {
+            uint32_t& s = nhash[i];
+            if (s == 0 || name(s - 1) == id) return s;
+        }
+    }
+
+    uint32_t& NNet::eslot(uint32_t src, uint32_t dest) const {
+        size_t mask = ehash.size() - 1;
+        for (size_t i = pairHash(src, dest) & mask;; i = (i + 1) & mask) {
+            uint32_t& s = ehash[i];
+            if (s == 0 || (synapses[s - 1].s == src && synapses[s - 1].d == dest)) return s;
+        }
+    }
+
+    void NNet::hashNode(uint32_t n) {
+        if (2 * (size_t(n) + 1) > nhash.size()) {
+            resetTable(nhash, n + 1);
+            for (uint32_t v = 0; v < n; ++v) nslot(name(v)) = v + 1;
+        }
+        nslot(name(n)) = n + 1;
+    }
+
+    void NNet::hashSynapse(uint32_t e) {
+        if (2 * (size_t(e) + 1) > ehash.size()) {
+            resetTable(ehash, e + 1);
+            for (uint32_t i = 0; i < e; ++i) eslot(synapses[i].s, synapses[i].d) = i + 1;
+        }
+        eslot(synapses[e].s, synapses[e].d) = e + 1;
     }
 
     // Add a synapse to the network
     void NNet::addS(const std::string& src, const std::string& dest, float weight) {
-        if (!nodes.count(src) || !nodes.count(dest))
+        auto w = write();
+        uint32_t s = id(src), d = id(dest);
+        if (s == npos || d == npos)
             throw std::runtime_error("Error: Undefined source or destination node.");
-        synapses.push_back(Synapse{src, dest, weight + randomFloat()}); // Add variability to weight
+        if (uint32_t e = synapse(s, d); e != npos) { // Merge the caller's weight as given, so Max is idempotent
+            float w = synapses[e].weight;
+            switch (merge) {
+                case Merge::Sum: w += weight; break;
+                case Merge::Max: w = std::max(w, weight); break;
+                case Merge::Ema: w += ema * (weight - w); break;
+            }
+            if (w != synapses[e].weight) reweigh(e, w);
+            born[e] = epoch;
+            return;
+        }
+        link(s, d);
+        weight += randomFloat(); // Add variability to new synapses
+        uint32_t e = static_cast<uint32_t>(synapses.size());
+        synapses.push_back(Synapse{s, d, weight});
+        born.push_back(epoch);
+        hashSynapse(e);
+        outNext.push_back(npos);
+        outPrev.push_back(npos);
+        rank(e);
+        inNext.push_back(inHead[d]);
+        inHead[d] = e;
+        touch(d);
+        dirty = true;
+    }
+
+    uint32_t NNet::synapse(uint32_t src, uint32_t dest) const {
+        return ehash.empty() ? npos : eslot(src, dest) - 1;
+    }
+
+    std::vector<uint32_t> NNet::top(uint32_t src, size_t k) const {
+        std::vector<uint32_t> r;
+        for (uint32_t e = outHead[src]; e != npos && r.size() < k; e = outNext[e]) r.push_back(e);
+        return r;
+    }
+
+    void NNet::setValue(uint32_t n, float v) {
+        auto w = write();
+        vals[n] = v;
+        for (uint32_t e = outHead[n]; e != npos; e = outNext[e]) touch(synapses[e].d);
+    }
+
+    void NNet::setWeight(size_t i, float w) {
+        auto g = write();
+        reweigh(i, w);
+    }
+
+    void NNet::reweigh(size_t i, float w) {
+        synapses[i].weight = w;
+        if (!dirty) inW[pos[i]] = w;
+        rank(static_cast<uint32_t>(i));
+        touch(synapses[i].d);
+    }
+
+    bool NNet::heavier(uint32_t a, uint32_t b) const {
+        float wa = synapses[a].weight, wb = synapses[b].weight;
+        return wa > wb || (wa == wb && a < b);
+    }
+
+    // Sorted list: take e out if present, then insert it before the first lighter synapse
+    void NNet::rank(uint32_t e) {
+        unrank(e);
+        uint32_t s = synapses[e].s, prev = npos, next = outHead[s];
+        while (next != npos && heavier(next, e)) {
+            prev = next;
+            next = outNext[next];
+        }
+        outPrev[e] = prev;
+        outNext[e] = next;
+        (prev == npos ? outHead[s] : outNext[prev]) = e;
+        if (next != npos) outPrev[next] = e;
+    }
+
+    void NNet::unrank(uint32_t e) {
+        uint32_t s = synapses[e].s, prev = outPrev[e], next = outNext[e];
+        if (prev == npos && outHead[s] != e) return; // Not listed yet
+        (prev == npos ? outHead[s] : outNext[prev]) = next;
+        if (next != npos) outPrev[next] = prev;
+        outPrev[e] = outNext[e] = npos;
+    }
+
+    // Relink n's outgoing synapses in ranked order; only this node's list is buffered
+    void NNet::sortOut(uint32_t n) {
+        thread_local std::vector<uint32_t> es;
+        es.clear();
+        for (uint32_t e = outHead[n]; e != npos; e = outNext[e]) es.push_back(e);
+        std::sort(es.begin(), es.end(), [&](uint32_t a, uint32_t b) { return heavier(a, b); });
+        uint32_t prev = npos;
+        for (uint32_t e : es) {
+            outPrev[e] = prev;
+            (prev == npos ? outHead[n] : outNext[prev]) = e;
+            prev = e;
+        }
+        if (prev != npos) outNext[prev] = npos;
+    }
+
+    NNet::Hold::Hold(NNet& n) : n(n) {
+        n.lock.lock();
+        n.writer.store(std::this_thread::get_id(), std::memory_order_relaxed);
+    }
+
+    NNet::Hold::~Hold() {
+        n.writer.store(std::thread::id(), std::memory_order_relaxed);
+        n.lock.unlock();
+    }
+
+    // Only this thread ever stores its own ID in writer, so a stale read cannot match
+    bool NNet::holding() const {
+        return writer.load(std::memory_order_relaxed) == std::this_thread::get_id();
+    }
+
+    std::unique_lock<std::shared_mutex> NNet::write() {
+        return holding() ? std::unique_lock(lock, std::defer_lock) : std::unique_lock(lock);
+    }
+
+    std::shared_lock<std::shared_mutex> NNet::read() const {
+        return holding() ? std::shared_lock(lock, std::defer_lock) : std::shared_lock(lock);
+    }
+
+    uint32_t NNet::mark() {
+        if (++tag == 0) {
+            std::fill(seen.begin(), seen.end(), 0);
+            tag = 1;
+        }
+        return tag;
+    }
+
+    // Pearce-Kelly: if d already comes after s nothing moves. Otherwise the nodes reachable from d and the
+    // nodes reaching s, both within the affected range of positions, swap into order on the same positions.
+    void NNet::link(uint32_t s, uint32_t d) {
+        if (s == d) throw std::runtime_error("Error: Cycle detected in the network.");
+        uint32_t lb = ord[d], ub = ord[s];
+        if (lb > ub) return;
+        mark();
+
+        // Forward from d over positions < ub; reaching s means a cycle
+        std::vector<uint32_t> fw{d}, bw{s}, stack{d};
+        seen[d] = tag;
+        while (!stack.empty()) {
+            uint32_t v = stack.back();
+            stack.pop_back();
+            for (uint32_t e = outHead[v]; e != npos; e = outNext[e]) {
+                uint32_t w = synapses[e].d;
+                if (w == s) throw std::runtime_error("Error: Cycle detected in the network.");
+                if (seen[w] != tag && ord[w] < ub) {
+                    seen[w] = tag;
+                    fw.push_back(w);
+                    stack.push_back(w);
+                }
+            }
+        }
+        // Backward from s over positions > lb
+        stack.push_back(s);
+        seen[s] = tag;
+        while (!stack.empty()) {
+            uint32_t v = stack.back();
+            stack.pop_back();
+            for (uint32_t e = inHead[v]; e != npos; e = inNext[e]) {
+                uint32_t w = synapses[e].s;
+                if (seen[w] != tag && ord[w] > lb) {
+                    seen[w] = tag;
+                    bw.push_back(w);
+                    stack.push_back(w);
+                }
+            }
+        }
+
+        // Reuse the vacated positions: everything reaching s first, then everything reachable from d
+        auto byOrd = [&](uint32_t a, uint32_t b) { return ord[a] < ord[b]; };
+        std::sort(fw.begin(), fw.end(), byOrd);
+        std::sort(bw.begin(), bw.end(), byOrd);
+        std::vector<uint32_t> slots;
+        slots.reserve(fw.size() + bw.size());
+        for (uint32_t v : bw) slots.push_back(ord[v]);
+        for (uint32_t v : fw) slots.push_back(ord[v]);
+        std::inplace_merge(slots.begin(), slots.begin() + bw.size(), slots.end());
+        size_t k = 0;
+        for (uint32_t v : bw) at[ord[v] = slots[k++]] = v;
+        for (uint32_t v : fw) at[ord[v] = slots[k++]] = v;
+    }
+
+    void NNet::compile() {
+        auto w = write();
+        csr();
+    }
+
+    // Node order from addS, then a counting sort of synapses by destination. Both sorts count into the
+    // offset column, turn the counts into end offsets and place entries back to front, which leaves the
+    // offsets at the starts and needs no separate cursors.
+    void NNet::csr() {
+        size_t n = types.size(), m = synapses.size();
+        if (m >= UINT32_MAX) throw std::runtime_error("Error: Too many synapses.");
+
+        inOff.clear();
+        inOff.resize(n + 1, 0);
+        for (const auto& syn : synapses) ++inOff[syn.d];
+        for (size_t v = 0, sum = 0; v <= n; ++v) inOff[v] = static_cast<uint32_t>(sum += inOff[v]);
+        inSrc.resize(m);
+        inW.resize(m);
+        pos.resize(m);
+        for (size_t i = m; i-- > 0;) {
+            const auto& syn = synapses[i];
+            uint32_t e = --inOff[syn.d];
+            inSrc[e] = syn.s;
+            inW[e] = syn.weight;
+            pos[i] = e;
+        }
+
+        // Levels, walking the maintained topological order
+        lvl.clear();
+        lvl.resize(n, 0);
+        uint32_t top = 0;
+        for (uint32_t v : at) {
+            for (uint32_t e = inOff[v]; e < inOff[v + 1]; ++e) lvl[v] = std::max(lvl[v], lvl[inSrc[e]] + 1);
+            top = std::max(top, lvl[v]);
+        }
+        lvlOff.clear();
+        lvlOff.resize(n ? top + 2 : 1, 0);
+        for (uint32_t v = 0; v < n; ++v) ++lvlOff[lvl[v]];
+        for (size_t l = 0, sum = 0; l < lvlOff.size(); ++l) lvlOff[l] = static_cast<uint32_t>(sum += lvlOff[l]);
+        order.resize(n);
+        for (size_t p = n; p-- > 0;) order[--lvlOff[lvl[at[p]]]] = at[p];
+        dirty = false;
     }
 
-    // Forward propagate through the network
+    // Each non-input node takes tanh of its weighted inputs; input nodes keep their values
+    void NNet::eval(uint32_t v) {
+        if (types[v] == NType::Input) return;
+        float sum = 0.0f;
+        for (uint32_t e = inOff[v]; e < inOff[v + 1]; ++e) {
+            sum += vals[inSrc[e]] * inW[e];
+        }
+        if (noise != 0.0f) {
+            for (uint32_t e = inOff[v]; e < inOff[v + 1]; ++e) {
+                sum += randomFloat(-noise, noise); // Add stochastic variability
+            }
+        }
+        vals[v] = std::tanh(sum); // Ensure values stay bounded
+    }
+
+    // Past an eighth of the nodes fwd() sweeps anyway, so stop listing them and keep the list small
+    void NNet::touch(uint32_t v) {
+        if (full) return;
+        stale.push_back(v);
+        if (stale.size() * 8 > types.size()) {
+            full = true;
+            stale.clear();
+        }
+    }
+
+    // Forward propagate through the network: the changed cone, or everything when that is cheaper
     void NNet::fwd() {
-        // Reset all node values before propagation
-        for (auto& [id, node] : nodes) {
-            node.value = (node.type == "input") ? node.value : 0.0f;
+        auto w = write();
+        if (dirty) csr();
+        if (full || stale.size() * 8 > types.size()) {
+            sweep();
+        } else {
+            update();
         }
+        stale.clear();
+        full = false;
+    }
 
-        // Perform propagation
-        for (const auto& syn : synapses) {
-            auto& srcNode = nodes[syn.src];
-            auto& destNode = nodes[syn.dest];
-            float delta = srcNode.value * syn.weight;
-            destNode.value += delta + randomFloat(); // Add stochastic variability
+    // A min-heap on topological position pops each node after all of its queued sources. A node's
+    // dependents are queued only if its value moved, so an absorbed change stops there.
+    void NNet::update() {
+        uint32_t t = mark();
+        auto later = [&](uint32_t a, uint32_t b) { return ord[a] > ord[b]; };
+        std::vector<uint32_t> heap;
+        for (uint32_t v : stale) {
+            if (seen[v] != t) {
+                seen[v] = t;
+                heap.push_back(v);
+            }
+        }
+        std::make_heap(heap.begin(), heap.end(), later);
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end(), later);
+            uint32_t v = heap.back();
+            heap.pop_back();
+            float old = vals[v];
+            eval(v);
+            if (vals[v] == old && types[v] != NType::Input) continue;
+            for (uint32_t e = outHead[v]; e != npos; e = outNext[e]) {
+                uint32_t w = synapses[e].d;
+                if (seen[w] != t) {
+                    seen[w] = t;
+                    heap.push_back(w);
+                    std::push_heap(heap.begin(), heap.end(), later);
+                }
+            }
+        }
+    }
+
+    // Forward propagate through the network, one level at a time
+    void NNet::sweep() {
+        if (threads != 1 && (!pool || (threads && pool->size() != threads))) {
+            pool = std::make_unique<Pool>(threads);
+            pool->run([](unsigned t) { Rng::stream(t); }); // Worker t draws noise from stream t
+        }
+        constexpr uint32_t minSplit = 1024; // Smaller levels are not worth a barrier
+        for (size_t l = 0; l + 1 < lvlOff.size(); ++l) {
+            uint32_t b = lvlOff[l], e = lvlOff[l + 1];
+            if (threads == 1 || e - b < minSplit) {
+                for (uint32_t k = b; k < e; ++k) eval(order[k]);
+                continue;
+            }
+            // Nodes of one level only read lower levels, so workers never touch each other's outputs
+            pool->each(e - b, [&](size_t i, size_t j, unsigned) {
+                for (size_t k = b + i; k < b + j; ++k) eval(order[k]);
+            });
+        }
+    }
+
+    // Same order as fwd(); the B states of a node are contiguous, so accumulate and tanh run across the batch
+    void NNet::infer(float* act, size_t B) const {
+        auto r = read();
+        propagate(act, B);
+    }
+
+    void NNet::propagate(float* act, size_t B) const {
+        if (dirty) throw std::runtime_error("Error: Network changed since compile().");
+        for (uint32_t v : order) {
+            if (types[v] == NType::Input) continue;
+            float* out = act + v * B;
+            std::fill(out, out + B, 0.0f);
+            for (uint32_t e = inOff[v]; e < inOff[v + 1]; ++e) {
+                Vec::axpy(inW[e], act + inSrc[e] * B, out, B);
+            }
+            Vec::tanh(out, B);
         }
+    }
 
-        // Normalize node values
-        for (auto& [id, node] : nodes) {
-            node.value = std::tanh(node.value); // Ensure values stay bounded
+    std::vector<std::vector<float>> NNet::infer(const std::vector<std::vector<float>>& inputs) const {
+        auto r = read();
+        std::vector<uint32_t> in = nodes(NType::Input), out = nodes(NType::Output);
+        size_t B = inputs.size();
+        std::vector<float> act(types.size() * B, 0.0f);
+        for (size_t b = 0; b < B; ++b) {
+            if (inputs[b].size() != in.size()) throw std::runtime_error("Error: Input size mismatch.");
+            for (size_t i = 0; i < in.size(); ++i) act[in[i] * B + b] = inputs[b][i];
         }
+        propagate(act.data(), B);
+        std::vector<std::vector<float>> res(B, std::vector<float>(out.size()));
+        for (size_t b = 0; b < B; ++b) {
+            for (size_t i = 0; i < out.size(); ++i) res[b][i] = act[out[i] * B + b];
+        }
+        return res;
+    }
+
+    std::vector<uint32_t> NNet::nodes(NType type) const {
+        std::vector<uint32_t> r;
+        for (uint32_t v = 0; v < types.size(); ++v) {
+            if (types[v] == type) r.push_back(v);
+        }
+        return r;
     }
 
     // Validate the network
     void NNet::validate() {
+        auto r = read();
         validateNodes();
         validateSynapses();
         checkCycles();
     }
 
     void NNet::validateNodes() const {
-        for (const auto& [id, node] : nodes) {
-            if (node.type != "input" && node.type != "hidden" && node.type != "output")
+        for (NType t : types) {
+            if (t != NType::Input && t != NType::Hidden && t != NType::Output)
                 throw std::runtime_error("Error: Invalid node type.");
         }
     }
 
     void NNet::validateSynapses() const {
         for (const auto& syn : synapses) {
-            if (!nodes.count(syn.src) || !nodes.count(syn.dest))
+            if (syn.s >= types.size() || syn.d >= types.size())
                 throw std::runtime_error("Error: Undefined nodes in synapse.");
         }
     }
 
     void NNet::checkCycles() const {
-        // Detect cycles using DFS
-        std::unordered_map<std::string, bool> visited;
-        std::unordered_map<std::string, bool> stack;
+        std::vector<uint32_t> order;
+        if (!topo(order)) {
+            throw std::runtime_error("Error: Cycle detected in the network.");
+        }
+    }
+
+    // Kahn's algorithm over the synapse list: repeatedly remove nodes with no incoming synapses
+    bool NNet::topo(std::vector<uint32_t>& order) const {
+        size_t n = types.size();
+        std::vector<uint32_t> off(n + 1, 0), dst(synapses.size()), indeg(n, 0);
+        for (const auto& syn : synapses) {
+            ++off[syn.s + 1];
+            ++indeg[syn.d];
+        }
+        for (size_t v = 0; v < n; ++v) off[v + 1] += off[v];
+        std::vector<uint32_t> fill(off.begin(), off.end() - 1);
+        for (const auto& syn : synapses) dst[fill[syn.s]++] = syn.d;
 
-        for (const auto& [id, node] : nodes) {
-            if (!visited[id] && dfsCycleCheck(id, visited, stack)) {
-                throw std::runtime_error("Error: Cycle detected in the network.");
+        order.clear();
+        order.reserve(n);
+        for (uint32_t v = 0; v < n; ++v) {
+            if (indeg[v] == 0) order.push_back(v);
+        }
+        for (size_t k = 0; k < order.size(); ++k) {
+            uint32_t u = order[k];
+            for (uint32_t e = off[u]; e < off[u + 1]; ++e) {
+                if (--indeg[dst[e]] == 0) order.push_back(dst[e]);
             }
         }
+        return order.size() == n;
     }
 
-    bool NNet::dfsCycleCheck(const std::string& nodeId,
-                             std::unordered_map<std::string, bool>& visited,
-                             std::unordered_map<std::string, bool>& stack) const {
-        visited[nodeId] = true;
-        stack[nodeId] = true;
+    void NNet::open(const std::string& dir) {
+        auto w = write();
+        std::filesystem::create_directories(dir);
+        text.open(dir + "/nodes.str");
+        noff.open(dir + "/nodes.off");
+        types.open(dir + "/nodes.type");
+        vals.open(dir + "/nodes.val");
+        synapses.open(dir + "/synapses");
 
+        // An interrupted addN / addS can leave one column ahead of the others: keep complete records only
+        size_t n = std::min({noff.size(), types.size(), vals.size()});
+        noff.resize(n);
+        types.resize(n);
+        vals.resize(n);
+        if (n > 0 && noff[n - 1] > text.size()) throw std::runtime_error("Error: Corrupt network files.");
+        text.resize(n ? noff[n - 1] : 0);
         for (const auto& syn : synapses) {
-            if (syn.src == nodeId) {
-                if (!visited[syn.dest] && dfsCycleCheck(syn.dest, visited, stack))
-                    return true;
-                else if (stack[syn.dest])
-                    return true;
+            if (syn.s >= n || syn.d >= n) throw std::runtime_error("Error: Corrupt network files.");
+        }
+
+        // Everything else is derived from the records and rebuilt, into files of its own so that it pages too
+        auto derived = [&](auto& col, const char* file) {
+            std::string path = dir + "/index." + file;
+            std::filesystem::remove(path);
+            col.open(path);
+        };
+        derived(nhash, "nodes");
+        derived(ehash, "synapses");
+        derived(ord, "ord");
+        derived(at, "at");
+        derived(outHead, "outhead");
+        derived(inHead, "inhead");
+        derived(outNext, "outnext");
+        derived(outPrev, "outprev");
+        derived(inNext, "innext");
+        derived(seen, "seen");
+        derived(born, "born");
+        derived(lvl, "lvl");
+        derived(order, "order");
+        derived(lvlOff, "lvloff");
+        derived(inOff, "inoff");
+        derived(inSrc, "insrc");
+        derived(inW, "inw");
+        derived(pos, "pos");
+        rebuild();
+    }
+
+    void NNet::rebuild(bool keepAges) {
+        size_t n = types.size(), m = synapses.size();
+        resetTable(nhash, n);
+        for (uint32_t v = 0; v < n; ++v) {
+            uint32_t& slot = nslot(name(v));
+            if (slot) throw std::runtime_error("Error: Duplicate node ID.");
+            slot = v + 1;
+        }
+
+        resetTable(ehash, m);
+        outHead.clear();
+        outHead.resize(n, npos);
+        inHead.clear();
+        inHead.resize(n, npos);
+        outNext.resize(m);
+        outPrev.resize(m);
+        inNext.resize(m);
+        for (uint32_t e = static_cast<uint32_t>(m); e-- > 0;) { // Back to front: lists come out in index order
+            const auto& syn = synapses[e];
+            eslot(syn.s, syn.d) = e + 1; // Older files may repeat a pair: first wins
+            outNext[e] = outHead[syn.s];
+            outHead[syn.s] = e;
+            inNext[e] = inHead[syn.d];
+            inHead[syn.d] = e;
+        }
+        for (uint32_t v = 0; v < n; ++v) sortOut(v);
+
+        // Kahn's algorithm in place: ord holds in-degrees while at fills up as the queue
+        ord.clear();
+        ord.resize(n, 0);
+        for (const auto& syn : synapses) ++ord[syn.d];
+        at.clear();
+        for (uint32_t v = 0; v < n; ++v) {
+            if (ord[v] == 0) at.push_back(v);
+        }
+        for (size_t k = 0; k < at.size(); ++k) {
+            for (uint32_t e = outHead[at[k]]; e != npos; e = outNext[e]) {
+                if (--ord[synapses[e].d] == 0) at.push_back(synapses[e].d);
             }
         }
-        stack[nodeId] = false;
-        return false;
+        if (at.size() != n) throw std::runtime_error("Error: Cycle detected in the network.");
+        for (uint32_t p = 0; p < n; ++p) ord[at[p]] = p;
+
+        seen.clear();
+        seen.resize(n, 0);
+        tag = 0;
+        if (!keepAges) {
+            born.clear();
+            born.resize(m, epoch);
+        }
+        stale.clear();
+        full = true;
+        dirty = true;
+    }
+
+    void NNet::clear() {
+        auto w = write();
+        wipe();
+    }
+
+    void NNet::wipe() {
+        text.clear();
+        noff.clear();
+        types.clear();
+        vals.clear();
+        synapses.clear();
+        rebuild();
+    }
+
+    void NNet::save(const std::string& path) const {
+        auto r = read();
+        std::ofstream out(path, std::ios::binary);
+        if (!out.is_open()) throw std::runtime_error("Error: Unable to save network to " + path);
+        size_t n = types.size(), m = synapses.size();
+
+        char hdr[SNAP_HDR] = {};
+        std::memcpy(hdr, "XINN", 4);
+        uint32_t h32[3] = {swapLE<uint32_t>(1), swapLE<uint32_t>(0x01020304u), 0};
+        uint64_t h64[3] = {swapLE<uint64_t>(n), swapLE<uint64_t>(m), swapLE<uint64_t>(text.size())};
+        std::memcpy(hdr + 4, h32, sizeof(h32));
+        std::memcpy(hdr + 16, h64, sizeof(h64));
+        uint32_t c = 0;
+        put(out, hdr, SNAP_HDR, c);
+
+        put(out, noff.data(), n, c);
+        put(out, reinterpret_cast<const uint8_t*>(types.data()), n, c);
+        put(out, vals.data(), n, c);
+        put(out, text.data(), text.size(), c);
+        static_assert(sizeof(Synapse) == 12, "Synapse is written as three 32-bit fields");
+        if constexpr (std::endian::native == std::endian::little) {
+            put(out, reinterpret_cast<const char*>(synapses.data()), m * sizeof(Synapse), c);
+        } else {
+            for (const auto& syn : synapses) {
+                put(out, &syn.s, 1, c);
+                put(out, &syn.d, 1, c);
+                put(out, &syn.weight, 1, c);
+            }
+        }
+        uint32_t le = swapLE(c);
+        out.write(reinterpret_cast<const char*>(&le), 4);
+        out.close();
+        if (!out) throw std::runtime_error("Error: Unable to save network to " + path);
+    }
+
+    void NNet::load(const std::string& path) {
+        auto w = write();
+        MMap f(path);
+        const char* p = f.data();
+        size_t size = f.size();
+        if (size < SNAP_HDR + 4 || std::memcmp(p, "XINN", 4) != 0 || get<uint32_t>(p + 4) != 1 ||
+            get<uint32_t>(p + 8) != 0x01020304u) {
+            throw std::runtime_error("Error: Not a network snapshot: " + path);
+        }
+        uint64_t n = get<uint64_t>(p + 16), m = get<uint64_t>(p + 24), t = get<uint64_t>(p + 32);
+        if (n >= UINT32_MAX || n > size || m > size || t > size ||
+            SNAP_HDR + n * 13 + t + m * 12 + 4 != size ||
+            get<uint32_t>(p + size - 4) != crc(0, p, size - 4)) {
+            throw std::runtime_error("Error: Corrupt network snapshot: " + path);
+        }
+        const char* offs = p + SNAP_HDR;
+        const char* typ = offs + n * 8;
+        const char* val = typ + n;
+        const char* txt = val + n * 4;
+        const char* syn = txt + t;
+
+        text.clear();
+        noff.clear();
+        types.clear();
+        vals.clear();
+        synapses.clear();
+        text.append(txt, t);
+        noff.resize(n);
+        types.resize(n);
+        vals.resize(n);
+        synapses.resize(m);
+        for (size_t v = 0; v < n; ++v) {
+            noff[v] = get<uint64_t>(offs + v * 8);
+            types[v] = static_cast<NType>(typ[v]);
+            vals[v] = get<float>(val + v * 4);
+            if (noff[v] > t || (v > 0 && noff[v] < noff[v - 1]) || typ[v] > 2) {
+                wipe();
+                throw std::runtime_error("Error: Corrupt network snapshot: " + path);
+            }
+        }
+        for (size_t i = 0; i < m; ++i) {
+            const char* r = syn + i * 12;
+            synapses[i] = Synapse{get<uint32_t>(r), get<uint32_t>(r + 4), get<float>(r + 8)};
+            if (synapses[i].s >= n || synapses[i].d >= n) {
+                wipe();
+                throw std::runtime_error("Error: Corrupt network snapshot: " + path);
+            }
+        }
+        try {
+            if ((n ? noff[n - 1] : 0) != t) throw std::runtime_error("Error: Corrupt network snapshot: " + path);
+            rebuild();
+        } catch (...) {
+            wipe();
+            throw;
+        }
+    }
+
+    void NNet::sync() {
+        auto r = read();
+        text.sync();
+        noff.sync();
+        types.sync();
+        vals.sync();
+        synapses.sync();
     }
 
     // Calculate the average weight of all synapses
     float NNet::avgWeight() const {
+        auto r = read();
         if (synapses.empty()) return 0.0f;
         float totalWeight = 0.0f;
         for (const auto& syn : synapses) {
@@ -104,20 +799,127 @@ namespace N3R {
 
     // Introduce noise into synapse weights
     void NNet::addWeightNoise(float noiseLevel) {
+        auto w = write();
+        for (size_t i = 0; i < synapses.size(); ++i) {
+            synapses[i].weight += randomFloat(-noiseLevel, noiseLevel);
+            if (!dirty) inW[pos[i]] = synapses[i].weight;
+        }
+        for (uint32_t v = 0; v < types.size(); ++v) sortOut(v);
+        full = true; // Every weight moved
+    }
+
+    bool NNet::weak(uint32_t e, float minWeight, uint32_t minAge) const {
+        return std::fabs(synapses[e].weight) < minWeight && epoch - born[e] >= minAge;
+    }
+
+    size_t NNet::prune(float minWeight, uint32_t minAge) {
+        auto w = write();
+        std::vector<uint32_t> drop;
+        for (uint32_t e = 0; e < synapses.size(); ++e) {
+            if (weak(e, minWeight, minAge)) drop.push_back(e);
+        }
+        ++epoch;
+        if (!drop.empty()) compact(drop);
+        return drop.size();
+    }
+
+    // Stable in-place filters over the columns, then renumbering. A file-backed network is rewritten in
+    // place, so an interrupted compaction can leave its files inconsistent.
+    void NNet::compact(const std::vector<uint32_t>& drop) {
+        size_t m = synapses.size(), n = types.size(), k = 0;
+        for (size_t e = 0, j = 0; e < m; ++e) {
+            if (j < drop.size() && drop[j] == e) {
+                ++j;
+                continue;
+            }
+            synapses[k] = synapses[e];
+            born[k++] = born[e];
+        }
+        synapses.resize(k);
+        born.resize(k);
+
+        // Inputs stay; hidden and output nodes need a synapse left. The search marks serve as the renumbering
+        // map; rebuild() resets them.
+        Col<uint32_t>& to = seen;
+        std::fill(to.begin(), to.end(), 0);
+        for (const auto& syn : synapses) to[syn.s] = to[syn.d] = 1;
+        uint32_t live = 0;
+        uint64_t from = 0, end = 0;
+        for (uint32_t v = 0; v < n; ++v) {
+            uint64_t next = noff[v];
+            if (types[v] == NType::Input || to[v]) {
+                std::memmove(text.data() + end, text.data() + from, next - from);
+                end += next - from;
+                noff[live] = end;
+                types[live] = types[v];
+                vals[live] = vals[v];
+                to[v] = live++;
+            }
+            from = next;
+        }
+        text.resize(end);
+        noff.resize(live);
+        types.resize(live);
+        vals.resize(live);
         for (auto& syn : synapses) {
-            syn.weight += randomFloat(-noiseLevel, noiseLevel);
+            syn.s = to[syn.s];
+            syn.d = to[syn.d];
+        }
+
+        rebuild(true);
+    }
+
+    void NNet::startPruning(float minWeight, uint32_t minAge, std::chrono::milliseconds period, size_t slice) {
+        stopPruning();
+        pruner = std::jthread([this, minWeight, minAge, period, slice](std::stop_token stop) {
+            std::mutex m;
+            std::condition_variable_any cv;
+            std::vector<uint32_t> drop;
+            size_t next = 0;
+            while (!stop.stop_requested()) {
+                bool done;
+                {
+                    std::shared_lock r(lock);
+                    size_t end = std::min(synapses.size(), next + slice);
+                    for (; next < end; ++next) {
+                        if (weak(static_cast<uint32_t>(next), minWeight, minAge)) drop.push_back(static_cast<uint32_t>(next));
+                    }
+                    done = next >= synapses.size();
+                }
+                if (done) {
+                    // The IDs scanned above may be stale: a foreground prune() / compact() (or load / open / clear)
+                    // renumbers synapses, and weights change. Re-checking each one under the exclusive lock is what
+                    // keeps this safe: only synapses weak now are dropped, and any missed are caught next pass.
+                    std::unique_lock w(lock);
+                    std::erase_if(drop, [&](uint32_t e) { return e >= synapses.size() || !weak(e, minWeight, minAge); });
+                    ++epoch;
+                    if (!drop.empty()) compact(drop);
+                    drop.clear();
+                    next = 0;
+                }
+                std::unique_lock g(m);
+                cv.wait_for(g, stop, period, [] { return false; });
+            }
+        });
+    }
+
+    void NNet::stopPruning() {
+        if (pruner.joinable()) {
+            pruner.request_stop();
+            pruner.join();
         }
     }
 
     // Print network structure
     void NNet::print() const {
-        for (const auto& [id, node] : nodes) {
-            std::cout << "Node: " << id << ", Type: " << node.type
-                      << ", Value: " << node.value << std::endl;
+        auto r = read();
+        for (uint32_t n = 0; n < types.size(); ++n) {
+            std::cout << "Node: " << name(n) << ", Type: " << typeName(types[n])
+                      << ", Value: " << vals[n] << std::endl;
         }
 
         for (const auto& syn : synapses) {
-            std::cout << "Synapse: " << syn.src << " -> " << syn.dest
+            std::cout << "Synapse: " << name(syn.s) << " -> " << name(syn.d)
                       << ", Weight: " << syn.weight << std::endl;
         }
     }
@@ -2,62 +2,233 @@
 #define N3R_H
 
 #include <string>
-#include <unordered_map>
 #include <vector>
 #include <iostream>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include "pool.h"
+#include "col.h"
 
 namespace N3R {
-    // Represents a node in the network.
-    struct Node {
-        std::string id;  // Unique identifier
-        std::string type; // Type: "input", "hidden", or "output"
-        float value;     // Current value
+    // Node type
+    enum class NType : uint8_t { Input, Hidden, Output };
+    NType parseType(const std::string& type); // "input", "hidden" or "output"; throws otherwise
+    const char* typeName(NType type);
+
+    // How addS folds the weight of a synapse that already exists into the stored one
+    enum class Merge : uint8_t {
+        Sum, // stored + new
+        Max, // max(stored, new)
+        Ema  // stored + ema * (new - stored)
     };
-    // Represents a synapse (connection) in the network.
+
+    // Represents a synapse (connection) in the network: a fixed-width record of interned nodes.
     struct Synapse {
-        std::string src;  // Source node ID
-        std::string dest; // Destination node ID
-        float weight;     // Synaptic weight
+        uint32_t s;   // Source node
+        uint32_t d;   // Destination node
+        float weight; // Synaptic weight
     };
     //Represents the neural network.
     class NNet {
     private:
-        std::unordered_map<std::string, Node> nodes; // Nodes in the network
-        
+        // Nodes, interned at addN: node n has ID name(n), type types[n] and value vals[n]. Everything kept per
+        // node or per synapse, records and the indexes over them alike, is a column of fixed-width entries; after
+        // open() every column is a mapped file, so the OS pages the graph in and out as it is touched. Only
+        // transient working sets (one search, one forward pass's queue, one node's synapses) use the heap.
+        Col<char> text{size_t(1) << 38};                  // Node IDs back to back
+        Col<uint64_t> noff;                               // End of node n's ID in text
+        Col<NType> types;
+        Col<float> vals;
+
+        // Lookup tables: open addressing with linear probing over a power-of-two column of ID + 1 (0 = empty),
+        // kept at most half full
+        Col<uint32_t> nhash{size_t(1) << 34};             // Nodes by ID
+        Col<uint32_t> ehash{size_t(1) << 34};             // Synapses by (source, destination)
+        uint32_t& nslot(std::string_view id) const;       // Slot holding that node, or the empty slot ending its probe
+        uint32_t& eslot(uint32_t s, uint32_t d) const;    // Likewise for the s -> d synapse
+        void hashNode(uint32_t n);                        // Enter node n (the newest), growing the table if due
+        void hashSynapse(uint32_t e);                     // Enter synapse e (the newest), growing the table if due
+
+        // Topological order kept up to date by addS (Pearce-Kelly): node n sits at position ord[n], at[p] is
+        // the node at position p. Adding a synapse only reorders the nodes between its endpoints.
+        Col<uint32_t> ord, at;
+        // Adjacency as lists threaded through the synapses (npos ends a list): each node's outgoing synapses
+        // heaviest first, doubly linked so that a reweighed synapse moves in place, and its incoming ones
+        Col<uint32_t> outHead, inHead;                // Per node: first synapse of each list
+        Col<uint32_t> outNext, outPrev, inNext;       // Per synapse: neighbours in its source's / destination's list
+        Col<uint32_t> seen;                           // Search marks (== tag when visited)
+        uint32_t tag = 0;
+        uint32_t mark();                              // Fresh tag: no node is marked with it yet
+
+        // Incremental fwd(): nodes whose sources or weights changed since the last pass. Only they and the
+        // nodes downstream of them are recomputed; full forces a pass over every node.
+        std::vector<uint32_t> stale;
+        bool full = true;
+        void touch(uint32_t v);                       // Mark node v stale
+
+        // Pruning: synapse e was last added or reinforced by addS during prune pass born[e]
+        Col<uint32_t> born;
+        uint32_t epoch = 0;
+        bool weak(uint32_t e, float minWeight, uint32_t minAge) const; // Whether prune() drops synapse e
+        void compact(const std::vector<uint32_t>& drop); // Remove sorted synapses drop, then orphaned nodes
+
+        // Compiled form used by fwd(), rebuilt after the graph changes (see compile())
+        bool dirty = true;
+        Col<uint32_t> lvl;     // Level of each node: 1 + the highest level of its sources
+        Col<uint32_t> order;   // Nodes grouped by level
+        Col<uint32_t> lvlOff;  // Nodes of level l: order[lvlOff[l], lvlOff[l + 1])
+        Col<uint32_t> inOff;   // Incoming synapses of node v: [inOff[v], inOff[v + 1])
+        Col<uint32_t> inSrc;   // Source node of each incoming synapse
+        Col<float> inW;        // Weight of each incoming synapse
+        Col<uint32_t> pos;     // Slot of synapses[i] in inSrc / inW
+
         void validateNodes() const; //Validate the nodes in the network.
         void validateSynapses() const; // Validate the synapses in the network.
 
-        /**
-         * @brief Check for cycles in the network using depth-first search.
-         * @param nodeId The current node ID being checked.
-         * @param visited Map tracking visited nodes.
-         * @param stack Map tracking the recursion stack.
-         * @return True if a cycle is detected, otherwise false.
-         */
-        bool dfsCycleCheck(const std::string& nodeId,
-                           std::unordered_map<std::string, bool>& visited,
-                           std::unordered_map<std::string, bool>& stack) const;
-        void checkCycles() const; // Check for cycles in the network.
+        std::unique_ptr<Pool> pool;   // Workers for the parallel forward pass (threads != 1)
+
+        std::atomic<std::thread::id> writer;      // Thread inside a Hold, if any
+        bool holding() const;                     // Whether this thread is inside a Hold
+        std::unique_lock<std::shared_mutex> write(); // Exclusive lock, unless this thread holds it already
+        std::shared_lock<std::shared_mutex> read() const; // Shared lock, unless this thread holds it already
+
+        // Bodies of the public members that lock, for use with the lock already held
+        void csr();                               // compile()
+        void reweigh(size_t i, float w);          // setWeight()
+        void wipe();                              // clear()
+        void propagate(float* act, size_t B) const; // infer()
+
+        void eval(uint32_t v);             // Recompute the value of node v from its sources
+        void sweep();                      // Recompute every node, level by level
+        void update();                     // Recompute the stale nodes and whatever their changes reach
+        void link(uint32_t s, uint32_t d); // Restore the topological order for a new synapse s -> d; throws on a cycle
+        bool heavier(uint32_t a, uint32_t b) const; // Ranking of outgoing synapses: weight descending, then index
+        void rank(uint32_t e);             // (Re)position synapse e among its source's outgoing synapses
+        void unrank(uint32_t e);           // Take synapse e out of its source's outgoing synapses
+        void sortOut(uint32_t n);          // Re-rank all of node n's outgoing synapses
+        bool topo(std::vector<uint32_t>& order) const; // Kahn's algorithm over the synapses; false on a cycle
+        void rebuild(bool keepAges = false); // Recreate the indexes, adjacency and order from the records
+        void checkCycles() const; // Check for cycles in the network (Kahn's algorithm, linear time).
     public:
-        std::vector<Synapse> synapses;              // Synapses in the network
+        Col<Synapse> synapses;                      // Synapses in the network (append through addS)
+        float noise = 0.05f;                        // Amplitude of the noise added per synapse in fwd (0 = deterministic)
+        unsigned threads = 1;                       // Forward pass worker threads (0 = all cores)
+        Merge merge = Merge::Max;                   // Policy for addS on an existing (source, destination)
+        float ema = 0.1f;                           // Rate of Merge::Ema
+
+        static constexpr uint32_t npos = UINT32_MAX; // Returned by id() for unknown nodes
+
+        // Members that change the network take this exclusively, and whole-network reads (save, infer,
+        // validate, avgWeight, print, sync) take it shared, so the background pruner (shared while it scans,
+        // exclusive while it compacts) is safe alongside any of them. Accessors for single elements and views
+        // (id, name, value, best, top, synapse, nodes, synapses) do not lock: a thread that uses them while
+        // another may change the network holds this shared across the reads and calls no locking member
+        // meanwhile, or takes a Hold. Pruning renumbers nodes and synapses, so indices are only stable while
+        // one of the two is held.
+        mutable std::shared_mutex lock;
+
+        // Exclusive hold for a sequence of calls that must not be split by the pruner or another writer,
+        // e.g. addN and then setValue on the node it returned. Members called inside do not lock again.
+        class Hold {
+            NNet& n;
+        public:
+            explicit Hold(NNet& n);
+            ~Hold();
+            Hold(const Hold&) = delete;
+            Hold& operator=(const Hold&) = delete;
+        };
+        Hold hold() { return Hold(*this); }
 
         /**
-         * @brief Add a node to the network.
+         * @brief Add a node to the network. Idempotent: if the ID exists, that node is left as it is.
          * @param id Unique identifier for the node.
          * @param type Node type: "input", "hidden", or "output".
          * @param value Initial value for the node.
+         * @return The interned node.
          */
-        void addN(const std::string& id, const std::string& type, float value);
+        uint32_t addN(const std::string& id, const std::string& type, float value);
+        uint32_t addN(const std::string& id, NType type, float value);
 
         /**
-         * @brief Add a synapse to the network.
+         * @brief Add a synapse to the network, or merge the weight into the existing src -> dest synapse
+         * according to merge. The network holds at most one synapse per (source, destination).
          * @param src Source node ID.
          * @param dest Destination node ID.
-         * @param weight Initial weight of the synapse.
+         * @param weight Initial weight of the synapse (a new synapse gets a small random jitter; merges use it as is).
+         * Throws, leaving the network unchanged, if the synapse would close a cycle.
          */
         void addS(const std::string& src, const std::string& dest, float weight);
+        uint32_t synapse(uint32_t src, uint32_t dest) const; // Index of the src -> dest synapse, npos if none
+
+        uint32_t id(std::string_view node) const; // Interned node for an ID, npos if unknown
+        std::string_view name(uint32_t n) const { return {text.data() + (n ? noff[n - 1] : 0), text.data() + noff[n]}; }
+        size_t size() const { return types.size(); }
+        float value(uint32_t n) const { return vals[n]; }
+        void setValue(uint32_t n, float v); // Set a node's value; the next fwd() updates only what n feeds
+        void setWeight(size_t i, float w);  // Set synapses[i]'s weight; the next fwd() updates its destination's cone
+        std::vector<uint32_t> nodes(NType type) const; // Interned nodes of a type, ascending
+
+        /**
+         * @brief Outgoing synapses of a node ranked by weight, heaviest first (ties: first added first).
+         * The ranking follows addS, setWeight and addWeightNoise; weights written directly to synapses are not seen.
+         * @return best: the heaviest synapse's index, npos if src has none. top: up to k synapse indices.
+         */
+        uint32_t best(uint32_t src) const { return outHead[src]; }
+        std::vector<uint32_t> top(uint32_t src, size_t k) const;
+
+        /**
+         * @brief Freeze the graph for fwd(): topological node order and incoming synapses as CSR arrays.
+         * fwd() calls this itself after addS; call it directly to pay the cost up front.
+         */
+        void compile();
+
+        /**
+         * @brief Keep the network in files under dir (created if needed) instead of memory: the node and
+         * synapse records, and the lookup, adjacency, order and compiled columns built over them here. The files
+         * are mapped, so the OS pages entries in on demand and can evict them again; addN / addS append to them.
+         * Replaces the current network with the directory's records (none for a new directory).
+         */
+        void open(const std::string& dir);
+        void sync(); // Flush a file-backed network to disk
+        void clear(); // Remove all nodes and synapses
+
+        /**
+         * Binary snapshot, all fields little-endian:
+         *   header (64 bytes): "XINN", u32 version 1, u32 0x01020304, u32 0, u64 nodes, u64 synapses, u64 text bytes
+         *   u64 ID end offsets[nodes], u8 types[nodes], f32 values[nodes], ID bytes,
+         *   {u32 src, u32 dest, f32 weight}[synapses], then u32 CRC-32 of everything before it
+         */
+        void save(const std::string& path) const;
+        void load(const std::string& path); // Replaces the network; columns are sized once, then filled in bulk
+        // Perform forward propagation through the network. Only nodes downstream of a change since the last
+        // call (setValue, setWeight, addN, addS) are recomputed, in topological order, and propagation stops
+        // where a recomputed value comes out unchanged. Otherwise (first call, load, open, addWeightNoise, or
+        // a change reaching much of the network) levels are evaluated in turn; with threads != 1 the nodes of
+        // large levels are split across workers. Each node pulls from its own incoming synapses in a fixed
+        // order, so with noise == 0 the result does not depend on the thread count or on which path ran.
+        void fwd();
+
+        /**
+         * @brief Batched, noise-free forward pass over B activation states; the network is not modified, so
+         * any number of threads may call this at once (after compile(), which it requires).
+         * @param act Caller-owned activations, structure of arrays: act[v * B + b] is node v in state b.
+         * Rows of input nodes are read; every other row is overwritten.
+         */
+        void infer(float* act, size_t B) const;
+
+        /**
+         * @brief Convenience form of infer(): inputs[b] lists values for nodes(NType::Input) in order.
+         * @return For each state, the values of nodes(NType::Output) in order.
+         */
+        std::vector<std::vector<float>> infer(const std::vector<std::vector<float>>& inputs) const;
 
-        void fwd(); // Perform forward propagation through the network.
         void validate(); // Validate the network structure. Ensures nodes and synapses are valid and checks for cycles.
 
         /**
@@ -72,9 +243,28 @@ namespace N3R {
          */
         void addWeightNoise(float noiseLevel);
 
+        /**
+         * @brief Drop weak synapses, then hidden and output nodes left without any synapse, and compact the
+         * columns in place (surviving nodes and synapses keep their relative order, but are renumbered).
+         * @param minWeight A synapse is dropped if |weight| is below this...
+         * @param minAge ...and this many passes have run since addS last added or reinforced it.
+         * @return The number of synapses removed.
+         */
+        size_t prune(float minWeight, uint32_t minAge = 0);
+
+        /**
+         * @brief Prune from a background thread (replacing any running one). Every period it scans the next
+         * `slice` synapses under a shared lock; after the last slice it takes the lock exclusively to
+         * compact. Ages restart when the network is loaded or opened.
+         */
+        void startPruning(float minWeight, uint32_t minAge, std::chrono::milliseconds period, size_t slice = 65536);
+        void stopPruning();
+
         void print() const; // Print the structure of the network. Outputs all nodes and synapses to the console.
+
+    private:
+        std::jthread pruner; // Last: joined before the columns it reads are destroyed
     };
 } // namespace N3R
 
 #endif // N3R_H
-
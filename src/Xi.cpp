@@ -6,61 +6,241 @@
 #include <unordered_map>
 #include <vector>
 #include <stdexcept>
+#include <limits>
+#include <algorithm>
+#include <thread>
+#include <exception>
+#include <charconv>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <filesystem>
 #include <bzlib.h>
 #include "utils.h"  // Utility functions
 #include "LM.h"     // Model 
 #include "N3R.h"    // Neural Network logic
 #include "Xi.h" 
 #include "zip.h"
+#include "pool.h"
+#include "rng.h"
+
+namespace {
+    // Splits a JSON stream into records as bytes arrive: the objects of a top-level array (a chat export)
+    // or top-level objects (JSON lines). Each byte is scanned once; only the open record is buffered.
+    class Splitter {
+        std::string cur;   // Bytes of the open record
+        int depth = 0;     // Nesting of {} and []
+        int base = 0;      // Depth at which records start
+        bool str = false;  // Inside a string
+        bool esc = false;  // After a backslash inside a string
+    public:
+        template <typename Emit> void feed(const char* p, size_t n, Emit&& emit) {
+            size_t from = depth > base ? 0 : n; // Start of the part of this chunk inside a record
+            for (size_t i = 0; i < n; ++i) {
+                char c = p[i];
+                if (str) {
+                    if (esc) esc = false;
+                    else if (c == '\\') esc = true;
+                    else if (c == '"') str = false;
+                    continue;
+                }
+                if (c == '"') {
+                    str = true;
+                } else if (c == '{' || c == '[') {
+                    if (depth == 0 && c == '[') base = 1; // Records are the array's elements
+                    if (depth == base && c == '{') from = i;
+                    ++depth;
+                } else if (c == '}' || c == ']') {
+                    if (--depth < 0) throw std::runtime_error("Malformed JSON: unbalanced brackets.");
+                    if (depth == base && c == '}') {
+                        cur.append(p + from, i + 1 - from);
+                        emit(std::move(cur));
+                        cur.clear();
+                        from = n;
+                    }
+                }
+            }
+            if (from < n) cur.append(p + from, n - from);
+        }
+        bool open() const { return depth > base; } // A record was cut off
+    };
+
+    // Raw value of a top-level key of a JSON object: a string's contents (escapes kept) or a scalar's text.
+    // Empty if the key is absent or its value is an object or array.
+    std::string_view topField(std::string_view rec, std::string_view key) {
+        size_t n = rec.size();
+        auto ws = [&](size_t i) {
+            while (i < n && (rec[i] == ' ' || rec[i] == '\t' || rec[i] == '\n' || rec[i] == '\r')) ++i;
+            return i;
+        };
+        auto strEnd = [&](size_t i) { // Closing quote of the string opening at i
+            for (++i; i < n && rec[i] != '"'; ++i) {
+                if (rec[i] == '\\') ++i;
+            }
+            return i;
+        };
+        int depth = 0;
+        for (size_t i = 0; i < n; ++i) {
+            char c = rec[i];
+            if (c == '"') {
+                size_t j = strEnd(i);
+                if (j >= n) return {};
+                size_t k = ws(j + 1);
+                if (depth == 1 && k < n && rec[k] == ':' && rec.substr(i + 1, j - i - 1) == key) {
+                    size_t v = ws(k + 1);
+                    if (v < n && rec[v] == '"') {
+                        size_t e = strEnd(v);
+                        return e < n ? rec.substr(v + 1, e - v - 1) : std::string_view{};
+                    }
+                    size_t e = v;
+                    while (e < n && rec[e] != ',' && rec[e] != '}' && rec[e] != ']' && rec[e] != ' ' && rec[e] != '\n') ++e;
+                    return rec.substr(v, e - v);
+                }
+                i = j;
+            } else if (c == '{' || c == '[') {
+                ++depth;
+            } else if (c == '}' || c == ']') {
+                --depth;
+            }
+        }
+        return {};
+    }
+
+    // What has been trained on: the newest update_time ingested (the watermark) and, per conversation, its
+    // update_time and a digest of its record. A known conversation at or below the watermark with an
+    // unchanged update_time is skipped without hashing; anything else is trained on unless its digest matches.
+    struct Seen {
+        struct Conv {
+            double time;
+            uint64_t digest;
+        };
+        double mark = 0.0;
+        std::unordered_map<std::string, Conv> convs;
+
+        static std::string key(std::string_view rec) {
+            std::string_view k = topField(rec, "conversation_id");
+            if (k.empty()) k = topField(rec, "id");
+            if (!k.empty()) return std::string(k);
+            return std::string(topField(rec, "title")) + '\x1f' + std::string(topField(rec, "create_time"));
+        }
+
+        // Whether rec needs training; if so, key and c describe it for commit()
+        bool fresh(std::string_view rec, std::string& k, Conv& c) const {
+            std::string_view t = topField(rec, "update_time");
+            c.time = 0.0;
+            std::from_chars(t.data(), t.data() + t.size(), c.time); // null or missing: 0
+            k = key(rec);
+            auto it = convs.find(k);
+            if (it != convs.end() && c.time <= mark && c.time == it->second.time) return false;
+            c.digest = fnv1a(rec);
+            return it == convs.end() || it->second.digest != c.digest;
+        }
+
+        void commit(std::vector<std::pair<std::string, Conv>>& done) {
+            for (auto& [k, c] : done) {
+                mark = std::max(mark, c.time);
+                convs[std::move(k)] = c;
+            }
+        }
 
+        // Text: "XISEEN 1 <watermark>", then "<digest hex> <update_time> <key>" per conversation
+        void save(const std::string& path) const {
+            std::ofstream out(path, std::ios::binary | std::ios::trunc);
+            char num[32];
+            out << "XISEEN 1 " << std::string_view(num, std::to_chars(num, num + sizeof(num), mark).ptr) << '\n';
+            for (const auto& [k, c] : convs) {
+                out << std::string_view(num, std::to_chars(num, num + sizeof(num), c.digest, 16).ptr) << ' ';
+                out << std::string_view(num, std::to_chars(num, num + sizeof(num), c.time).ptr) << ' ' << k << '\n';
+            }
+            if (!out) throw std::runtime_error("Unable to write ingestion state: " + path);
+        }
+
+        void load(const std::string& path) {
+            convs.clear();
+            mark = 0.0;
+            std::ifstream in(path, std::ios::binary);
+            if (!in.is_open()) return; // Nothing ingested yet
+            std::string line;
+            auto bad = [&] { throw std::runtime_error("Corrupt ingestion state: " + path); };
+            if (!std::getline(in, line) || line.rfind("XISEEN 1 ", 0) != 0) bad();
+            if (std::from_chars(line.data() + 9, line.data() + line.size(), mark).ec != std::errc()) bad();
+            while (std::getline(in, line)) {
+                const char* p = line.data();
+                const char* e = p + line.size();
+                Conv c;
+                auto r = std::from_chars(p, e, c.digest, 16);
+                if (r.ec != std::errc() || r.ptr == e || *r.ptr != ' ') bad();
+                r = std::from_chars(r.ptr + 1, e, c.time);
+                if (r.ec != std::errc() || r.ptr == e || *r.ptr != ' ') bad();
+                convs.emplace(std::string(r.ptr + 1, e), c);
+            }
+        }
+    };
+}
 
 namespace Xi {
 
     // Global state for training and model management
     LM model(50, 0.01, 0.001, 0.01);
-    const std::string fM = "data/model.bz2";
+    const std::string fM = "data/model.xlm";
     const std::string fGPT = "data/conversations.json";
 
-    N3R::NNet nnet;
-    std::string sha; // Track last trained state
+    N3R::NNet nnet; // Mapped from files next to the model (see loadModel)
+    Seen seen; // Conversations trained on so far (persisted next to the model)
     
-void Xi::trn3R(const std::vector<TrnData>& data, float l, float t, float alpha, float beta, int maxE) {
+    void trn3R(const std::vector<TrnData>& data, float l, float t, float alpha, float beta, int maxE) {
         if (data.empty()) {
-            log(Log::ERROR, "Training data is empty. Cannot train.");
+            Utils::log(Utils::Log::ERROR, "Training data is empty. Cannot train.");
             throw std::runtime_error("Training data is empty. Cannot train.");
         }
         if (maxE <= 0) {
-            log(Log::ERROR, "Maximum number of epochs must be greater than zero.");
+            Utils::log(Utils::Log::ERROR, "Maximum number of epochs must be greater than zero.");
             throw std::runtime_error("Maximum number of epochs must be greater than zero.");
         }
 
+        // Resolve words to rows once, before the workers start (addWord is not thread-safe)
+        std::vector<std::pair<uint32_t, uint32_t>> rows(data.size());
+        for (size_t i = 0; i < data.size(); ++i) {
+            rows[i] = {model.addWord(data[i].tgt), model.addWord(data[i].ctx)};
+        }
+
+        // Hogwild shards as in LM::train; each worker sums its loss into its own cache line
+        Pool pool(model.threads);
+        pool.run([](unsigned w) { Rng::stream(w); });
+        struct alignas(64) Part { double loss = 0.0; };
+        std::vector<Part> part(pool.size());
+
         float prevL = std::numeric_limits<float>::max(); // Previous loss for convergence check
         float loss = 0.0f; // Current loss
 
         for (int en = 0; en < maxE; ++en) {
-            loss = 0.0f; // Reset loss for each epoch
-
-            for (const auto& r : data) {
-                auto tgtE = model.getE(r.tgt);
-                auto ctxE = model.getE(r.ctx);
-
-                // Update embeddings using plasticity
-                model.updE(tgtE, ctxE, l, alpha);
-
-                // Calculate loss
-                float d = std::inner_product(tgtE.begin(), tgtE.end(), ctxE.begin(), 0.0f);
-                loss += model.calcL(d, r.lbl);
-            }
+            auto t0 = std::chrono::steady_clock::now();
+            for (auto& p : part) p.loss = 0.0;
+
+            pool.each(data.size(), [&](size_t b, size_t e, unsigned w) {
+                double sum = 0.0;
+                for (size_t i = b; i < e; ++i) {
+                    // Update embeddings using plasticity, then score the pair
+                    sum += model.fit(rows[i].first, rows[i].second, data[i].lbl, l, alpha);
+                }
+                part[w].loss += sum;
+            });
+            double total = 0.0;
+            for (const auto& p : part) total += p.loss;
+            loss = static_cast<float>(total);
 
             // Apply forgetting (decay unused connections) every 5 epochs
-            if (en % 5 == 0) model.dcyW(beta);
+            if (en % 5 == 0) model.forget(beta);
 
             // Log progress based on log level
-            log(Log::DEBUG, "Epoch " + std::to_string(en + 1) + ": Loss = " + std::to_string(loss / data.size()));
+            std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+            Utils::log(Utils::Log::DEBUG, "Epoch " + std::to_string(en + 1) + ": Loss = " + std::to_string(loss / data.size()) +
+                       ", " + std::to_string(static_cast<size_t>(data.size() / std::max(dt.count(), 1e-9))) + " pairs/s (" +
+                       std::to_string(pool.size()) + " threads)");
 
             // Convergence check
             if (std::abs(prevL - loss) < t) {
-                log(Log::INFO, "Convergence after " + std::to_string(en + 1) + " epochs.");
+                Utils::log(Utils::Log::INFO, "Convergence after " + std::to_string(en + 1) + " epochs.");
                 break;
             }
 
@@ -70,120 +250,219 @@ void Xi::trn3R(const std::vector<TrnData>& data, float l, float t, float alpha,
 
     void loadModel(const std::string& f) {
         std::cout << "Loading model: " << f << std::endl;
+        nnet.open(f + ".net"); // Paged in on demand, so the network may outgrow memory
+
+        // A model saved before the .xlm format sits next to it as .bz2: load that once and save it as f
+        std::string src = f;
+        if (std::filesystem::path p(f); p.extension() == ".xlm" && !std::filesystem::exists(p)) {
+            std::string legacy = p.replace_extension(".bz2").string();
+            if (std::filesystem::exists(legacy)) {
+                std::cout << "Migrating legacy model " << legacy << " to " << f << std::endl;
+                src = legacy;
+            }
+        }
 
         try {
             // Try to load the existing model
-            load(f);
+            load(src);
             std::cout << "Model loaded successfully." << std::endl;
-
-            if (sha256(fGPT) != sha) {
-                std::cout << "New data detected. Incremental training starting...\n";
-                ldzJSON("data/gpt.zip", "conversations.json");
-                train(10);
-                sha = sha256(fGPT);
-                save(f);
-                std::cout << "Training complete. Model updated." << std::endl;
-            } else {
-                std::cout << "No data updates. Model is up to date.\n";
-            }
         } catch (const std::runtime_error& e) {
-            // If loading fails, train from gpt.zip and save the model
+            // If loading fails, train a new model from gpt.zip and save it. Only a failed load gets here: an
+            // ingestion error on top of a loaded model propagates instead of replacing that model.
             std::cerr << "Error loading model: " << e.what() << "\nTraining new model from gpt.zip..." << std::endl;
 
-            ldzJSON("data/gpt.zip", "conversations.json");
-            train(10);
+            model = LM(50, 0.01, 0.001, 0.01); // Drop whatever the failed load left behind
+            nnet.clear();
+            seen = Seen(); // Nothing in a new model has been trained on
+            ldzJSON("data/gpt.zip", "conversations.json"); // Trains through trn3R as it reads
             save(f);
             std::cout << "New model trained and saved to " << f << std::endl;
+            return;
+        }
+
+        // Only conversations that are new or changed since the last save are parsed further and trained on
+        if (ldzJSON("data/gpt.zip", "conversations.json") > 0 || src != f) {
+            save(f);
+            std::cout << "Training complete. Model updated." << std::endl;
+        } else {
+            std::cout << "No data updates. Model is up to date.\n";
         }
     }
 
     
     void load(const std::string& filePath) {
-        BZFILE* file = BZ2_bzopen(filePath.c_str(), "rb");
-        if (!file) {
-            throw std::runtime_error("Unable to open model file for reading: " + filePath);
-        }
+        std::ifstream probe(filePath, std::ios::binary);
+        char magic[4] = {};
+        probe.read(magic, sizeof(magic));
+        probe.close();
+
+        if (std::string(magic, 4) == "XILM") {
+            model.map(filePath); // Served in place, no decompression or parsing
+        } else {
+            // Legacy bzip2-compressed model
+            BZFILE* file = BZ2_bzopen(filePath.c_str(), "rb");
+            if (!file) {
+                throw std::runtime_error("Unable to open model file for reading: " + filePath);
+            }
 
-        constexpr int BUFFER_SIZE = 4096;
-        char buffer[BUFFER_SIZE];
-        std::string modelData;
-        int bytesRead;
+            constexpr int BUFFER_SIZE = 1 << 20;
+            std::vector<char> buffer(BUFFER_SIZE);
+            std::string modelData;
+            int bytesRead;
 
-        while ((bytesRead = BZ2_bzread(file, buffer, BUFFER_SIZE)) > 0) {
-            modelData.append(buffer, bytesRead);
-        }
+            while ((bytesRead = BZ2_bzread(file, buffer.data(), BUFFER_SIZE)) > 0) {
+                modelData.append(buffer.data(), bytesRead);
+            }
 
-        BZ2_bzclose(file);
+            BZ2_bzclose(file);
+            model.deserialize(modelData);
+        }
 
-        // Deserialize model data (Assuming the model supports a deserialize method)
-        model.deserialize(modelData);
+        try {
+            model.loadIndex(filePath + ".hnsw"); // Nearest-neighbour index saved next to the model
+        } catch (const std::runtime_error&) {
+            // Missing or stale: the first nearest() query rebuilds it
+        }
+        seen.load(filePath + ".seen"); // Ingestion watermark saved next to the model
         std::cout << "Model loaded successfully from " << filePath << std::endl;
     }
     
     void save(const std::string& filePath) {
-        BZFILE* file = BZ2_bzopen(filePath.c_str(), "wb");
-        if (!file) {
-            throw std::runtime_error("Unable to open model file for writing: " + filePath);
-        }
-
-        // Serialize model data (Assuming the model supports a serialize method)
-        std::string modelData = model.serialize();
-
-        if (BZ2_bzwrite(file, modelData.data(), modelData.size()) < 0) {
-            BZ2_bzclose(file);
-            throw std::runtime_error("Error writing model data to file: " + filePath);
-        }
-
-        BZ2_bzclose(file);
+        // Uncompressed so load() can map it directly
+        model.write(filePath);
+        model.saveIndex(filePath + ".hnsw");
+        seen.save(filePath + ".seen");
+        nnet.sync();
         std::cout << "Model saved successfully to " << filePath << std::endl;
     }
     
-    void ldzJSON(const std::string& zf, const std::string& fn, int ep, float lr, float t, float a, float b) {
-        Zip z(zf);  // Open the zip file
-
-        z.ext(fn, [&](const char* buf, size_t sz) {
-            static std::string bufStr; // Accumulate data from chunks
-            bufStr.append(buf, sz);
+    size_t ldzJSON(const std::string& zf, const std::string& fn, int ep, float lr, float t, float a, float b) {
+        Zip z(zf);  // Open the zip file (mapped)
+
+        // inflate -> split into records -> parse into pairs -> train (this thread). Each queue holds at most
+        // `depth` items, so memory stays bounded however large the archive is.
+        constexpr size_t depth = 64, batch = 1 << 14;
+        Queue<std::string> chunks(depth), records(depth);
+        Queue<std::vector<TrnData>> pairs(depth);
+        // The first failure in time is the one reported: closing the queues makes the other stages fail
+        // with "cancelled" after it
+        std::mutex em;
+        std::exception_ptr err;
+        std::atomic<bool> failed{false};
+        auto fail = [&](std::exception_ptr e) {
+            {
+                std::lock_guard<std::mutex> lk(em);
+                if (!err) err = e;
+            }
+            failed = true;
+            chunks.close();
+            records.close();
+            pairs.close();
+        };
+        auto stage = [&](auto& out, auto body) {
+            return std::thread([&, body] {
+                try {
+                    body();
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+                out.close();
+            });
+        };
+
+        std::thread inflater = stage(chunks, [&] {
+            z.stream(fn, [&](const char* p, size_t n) {
+                if (!chunks.push(std::string(p, n))) throw std::runtime_error("Ingestion cancelled.");
+            });
+        });
+        std::thread splitter = stage(records, [&] {
+            Splitter sp;
+            std::string chunk;
+            while (chunks.pop(chunk)) {
+                sp.feed(chunk.data(), chunk.size(), [&](std::string&& r) {
+                    if (!records.push(std::move(r))) throw std::runtime_error("Ingestion cancelled.");
+                });
+            }
+            if (sp.open()) throw std::runtime_error("Truncated JSON in " + fn);
+        });
+        std::vector<std::pair<std::string, Seen::Conv>> done; // Conversations passed on for training
+        size_t skipped = 0;
+        std::thread parser = stage(pairs, [&] {
+            std::string r;
+            while (records.pop(r)) {
+                std::string key;
+                Seen::Conv c;
+                if (!seen.fresh(r, key, c)) {
+                    ++skipped;
+                    continue;
+                }
+                done.emplace_back(std::move(key), c);
 
-            try {
                 std::unordered_map<std::string, std::string> nd; // Node data
-                auto pcm = Utils::chat(bufStr, nd);  // Parent-child map
+                auto pcm = Utils::chatJSON(r, nd);  // Parent-child map
 
-                std::vector<Xi::TrnData> td; // Training data
+                std::vector<TrnData> td; // Training data
                 for (const auto& [p, cList] : pcm) {
-                    std::string pc = nd[p]; // Parent content
+                    const std::string& pc = nd[p]; // Parent content
                     for (const auto& c : cList) {
-                        std::string cc = nd[c]; // Child content
-                        td.emplace_back(pc, cc, 1.0f);
+                        td.push_back({pc, nd[c], 1.0f}); // Child content
                     }
                 }
-
-                // Train on this chunk
-                if (!td.empty()) {
-                    Xi::trn3R(td, lr, t, a, b, ep);
-                    std::cout << "Trained on " << td.size() << " samples.\n";
-                }
-
-                bufStr.clear(); // Clear buffer after processing
-            } catch (const std::exception&) {
-                // JSON incomplete, continue accumulating chunks
+                if (!td.empty() && !pairs.push(std::move(td))) throw std::runtime_error("Ingestion cancelled.");
             }
         });
 
-        std::cout << "Training completed from " << fn << " in " << zf << ".\n";
+        // Train on batches of pairs as they arrive; once any stage has failed nothing more is trained, as
+        // the run will not be committed
+        try {
+            std::vector<TrnData> td, more;
+            auto flush = [&] {
+                Xi::trn3R(td, lr, t, a, b, ep);
+                std::cout << "Trained on " << td.size() << " samples.\n";
+                td.clear();
+            };
+            while (!failed && pairs.pop(more)) {
+                std::move(more.begin(), more.end(), std::back_inserter(td));
+                if (td.size() >= batch && !failed) flush();
+            }
+            if (!td.empty() && !failed) flush();
+        } catch (...) {
+            fail(std::current_exception());
+        }
+        inflater.join();
+        splitter.join();
+        parser.join();
+
+        if (err) std::rethrow_exception(err);
+        seen.commit(done); // Only once everything trained: a failed run is retried in full next time
+        std::cout << "Training completed from " << fn << " in " << zf << ": " << done.size() << " new or changed, "
+                  << skipped << " unchanged conversations.\n";
+        return done.size();
     }
 
     std::string generateResponse(const std::string& userInput) {
         auto contextEmbedding = model.getContextEmbedding({userInput});
-        nnet.addN(userInput, "input", 1.0f);
-
+        // Strongest response straight from the ranked outgoing synapses
         std::string bestResponse;
-        float maxWeight = -1.0f;
+        auto strongest = [&](uint32_t src) {
+            if (uint32_t e = src == N3R::NNet::npos ? N3R::NNet::npos : nnet.best(src);
+                e != N3R::NNet::npos && nnet.synapses[e].weight > -1.0f)
+                bestResponse = nnet.name(nnet.synapses[e].d);
+        };
+        {
+            // Look the input up without inserting it, so requests cannot grow the network; server workers
+            // share the lock and run side by side
+            std::shared_lock<std::shared_mutex> lk(nnet.lock);
+            strongest(nnet.id(userInput));
+        }
 
-        for (const auto& syn : nnet.synapses) {
-            if (syn.src == userInput && syn.weight > maxWeight) {
-                maxWeight = syn.weight;
-                bestResponse = syn.dest;
+        // Unseen input: answer as for the semantically closest known words
+        if (bestResponse.empty() && model.id(userInput) != LM::npos) {
+            auto near = model.nearest(userInput, 5);
+            std::shared_lock<std::shared_mutex> lk(nnet.lock);
+            for (const auto& [w, sim] : near) {
+                strongest(nnet.id(model.word(w)));
+                if (!bestResponse.empty()) break;
             }
         }
 
@@ -6,15 +6,29 @@
 #include <utility>
 
 namespace Xi {
-    // Initialize and load the model
-    void loadModel(const std::string& f = "data/model.bz2");
-    void train(int epochs); // Train the model 
+    // One supervised training pair: target and context words, and the similarity their rows should reach
+    struct TrnData {
+        std::string tgt;
+        std::string ctx;
+        float lbl;
+    };
+
+    // Initialize and load the model; a legacy .bz2 model next to a missing .xlm f is loaded and saved as f
+    void loadModel(const std::string& f = "data/model.xlm");
+    // Mini-batch trainer: rate l, convergence threshold t on the epoch loss, plasticity decay alpha,
+    // forgetting beta every 5 epochs, at most maxE epochs. Epochs are sharded across model.threads workers.
+    void trn3R(const std::vector<TrnData>& data, float l, float t, float alpha, float beta, int maxE);
     std::string generateResponse(const std::string& userInput); // Generate a response based on user input
     void saveConversation(const std::string& topic, const std::vector<std::pair<int64_t, std::string>>& newMessages); // Save a conversation topic
     void loadJSON(); // Load JSON conversation data
-    void ldzJSON(const std::string& zf, const std::string& fn); // load zipped JSON conversation
-    void load(const std::string& filePath); // Load model from a bzip2 file
-    void save(const std::string& filePath); // Save model to a bzip2 file
+    // Train on conversations fn inside zip archive zf: inflate, record splitting, parsing into pairs and
+    // training (trn3R with the remaining arguments) run as a pipeline of threads joined by bounded queues.
+    // Conversations unchanged since the last save (watermark and digests in <model>.seen) are skipped.
+    // Returns the number of conversations trained on.
+    size_t ldzJSON(const std::string& zf, const std::string& fn, int ep = 10, float lr = 0.01f, float t = 1e-4f,
+                 float a = 0.001f, float b = 0.01f);
+    void load(const std::string& filePath); // Load model: mapped model file, or legacy bzip2
+    void save(const std::string& filePath); // Save model file (mappable binary format)
     void adjustParameters(int epoch);
 }
 
@@ -0,0 +1,94 @@
+#include "col.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <new>
+#include <utility>
+
+namespace {
+    // A function-local static: columns of global objects are constructed before this file's globals
+    size_t pageSize() {
+        static const size_t p = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+        return p;
+    }
+    size_t roundUp(size_t n, size_t a) { return (n + a - 1) / a * a; }
+}
+
+Region::Region(size_t reserve) : res(roundUp(reserve, pageSize())) {
+    void* p = mmap(nullptr, res, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED) throw std::runtime_error("Unable to reserve address space.");
+    base = static_cast<char*>(p);
+}
+
+Region::~Region() {
+    release();
+}
+
+Region::Region(Region&& o) noexcept
+    : base(std::exchange(o.base, nullptr)), res(std::exchange(o.res, 0)), cap(std::exchange(o.cap, 0)),
+      fd(std::exchange(o.fd, -1)) {}
+
+Region& Region::operator=(Region&& o) noexcept {
+    if (this != &o) {
+        release();
+        base = std::exchange(o.base, nullptr);
+        res = std::exchange(o.res, 0);
+        cap = std::exchange(o.cap, 0);
+        fd = std::exchange(o.fd, -1);
+    }
+    return *this;
+}
+
+void Region::release() {
+    if (base) munmap(base, res);
+    if (fd >= 0) ::close(fd);
+    base = nullptr;
+    fd = -1;
+    cap = 0;
+}
+
+// Drop the current contents and map the file over the start of the range
+void Region::open(const std::string& path) {
+    int f = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (f < 0) throw std::runtime_error("Unable to open file: " + path);
+    struct stat st;
+    if (fstat(f, &st) != 0) {
+        ::close(f);
+        throw std::runtime_error("Unable to stat file: " + path);
+    }
+    size_t n = roundUp(static_cast<size_t>(st.st_size), pageSize());
+    if (n > res || (n != static_cast<size_t>(st.st_size) && ftruncate(f, n) != 0)) {
+        ::close(f);
+        throw std::runtime_error("Unable to map file: " + path);
+    }
+    // Return the range to reserved-only, then map the file at its start
+    if (mmap(base, res, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED ||
+        (n > 0 && mmap(base, n, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, f, 0) == MAP_FAILED)) {
+        ::close(f);
+        throw std::runtime_error("Unable to map file: " + path);
+    }
+    if (fd >= 0) ::close(fd);
+    fd = f;
+    cap = n;
+}
+
+// Grow geometrically (at least 64 KiB) so appends stay amortized O(1)
+void Region::grow(size_t bytes) {
+    if (bytes <= cap) return;
+    size_t n = roundUp(std::max({bytes, cap * 2, size_t(64) << 10}), pageSize());
+    if (n > res) n = roundUp(bytes, pageSize());
+    if (n > res) throw std::runtime_error("Region exceeds its reserved address space.");
+    if (fd < 0) {
+        if (mprotect(base + cap, n - cap, PROT_READ | PROT_WRITE) != 0) throw std::bad_alloc();
+    } else if (ftruncate(fd, n) != 0 ||
+               mmap(base + cap, n - cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, cap) == MAP_FAILED) {
+        throw std::runtime_error("Unable to extend mapped file.");
+    }
+    cap = n;
+}
+
+void Region::sync() {
+    if (fd >= 0 && cap > 0) msync(base, cap, MS_SYNC);
+}
@@ -0,0 +1,108 @@
+#ifndef COL_H
+#define COL_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+// A fixed address range reserved up front and made usable from the start as it grows, so the contents never
+// move. Anonymous memory by default; after open() it maps a file (MAP_SHARED), whose pages the OS loads on
+// demand and writes back itself.
+class Region {
+    char* base = nullptr;
+    size_t res = 0; // Reserved bytes
+    size_t cap = 0; // Usable bytes [0, cap)
+    int fd = -1;    // Backing file, -1 = anonymous
+
+    void release();
+public:
+    explicit Region(size_t reserve = size_t(1) << 38);
+    ~Region();
+    Region(Region&& o) noexcept;
+    Region& operator=(Region&& o) noexcept;
+    Region(const Region&) = delete;
+    Region& operator=(const Region&) = delete;
+
+    void open(const std::string& path); // Switch to a file (created if missing); existing bytes are kept in the file
+    void grow(size_t bytes);            // Make at least [0, bytes) usable (file mode extends the file)
+    void sync();                        // Write dirty pages of a file-backed region to disk
+    char* data() const { return base; }
+    size_t capacity() const { return cap; }
+    bool mapped() const { return fd >= 0; }
+};
+
+/**
+ * @class Col
+ * Growable array of fixed-width records in a Region: elements keep their addresses as the array grows, so
+ * pointers and string_views into it stay valid. The element count lives in a 64-byte header in the same
+ * region ("XICOL1", record size, count), so a file-backed Col reopens with its contents. Address space is
+ * reserved for at most maxCount records (by default one per 32-bit ID).
+ */
+template <typename T>
+class Col {
+    static_assert(std::is_trivially_copyable_v<T>, "Col holds fixed-width records");
+    static constexpr size_t H = 64;
+    Region r;
+
+    uint64_t& count() const { return *reinterpret_cast<uint64_t*>(r.data() + 16); }
+    void header() {
+        r.grow(H);
+        std::memcpy(r.data(), "XICOL1\0\0", 8);
+        uint64_t w = sizeof(T);
+        std::memcpy(r.data() + 8, &w, 8);
+        count() = 0;
+    }
+public:
+    explicit Col(size_t maxCount = size_t(1) << 32) : r(H + maxCount * sizeof(T)) { header(); }
+
+    // Back the column by a file; an existing file is opened with its contents
+    void open(const std::string& path) {
+        r.open(path);
+        if (r.capacity() == 0) { // New file
+            header();
+            return;
+        }
+        uint64_t w;
+        std::memcpy(&w, r.data() + 8, 8);
+        if (r.capacity() < H || std::memcmp(r.data(), "XICOL1", 6) != 0 || w != sizeof(T) ||
+            H + count() * sizeof(T) > r.capacity()) {
+            throw std::runtime_error("Corrupt column file: " + path);
+        }
+    }
+
+    size_t size() const { return count(); }
+    bool empty() const { return count() == 0; }
+    bool mapped() const { return r.mapped(); }
+    void sync() { r.sync(); }
+
+    T* data() const { return reinterpret_cast<T*>(r.data() + H); }
+    T* begin() const { return data(); }
+    T* end() const { return data() + count(); }
+    T& operator[](size_t i) const { return data()[i]; }
+    T& back() const { return data()[count() - 1]; }
+
+    void reserve(size_t n) { r.grow(H + n * sizeof(T)); }
+    void push_back(const T& v) {
+        size_t n = count();
+        if (H + (n + 1) * sizeof(T) > r.capacity()) reserve(n + 1);
+        data()[n] = v;
+        count() = n + 1;
+    }
+    void append(const T* p, size_t k) {
+        size_t n = count();
+        reserve(n + k);
+        std::memcpy(static_cast<void*>(data() + n), p, k * sizeof(T));
+        count() = n + k;
+    }
+    void resize(size_t n, const T& v = T()) {
+        reserve(n);
+        for (size_t i = count(); i < n; ++i) data()[i] = v;
+        count() = n;
+    }
+    void clear() { count() = 0; }
+};
+
+#endif // COL_H
@@ -17,7 +17,7 @@ namespace GPT {
     
     // Train or retrain the model based on data changes
     bool init(LM::Model& model, const std::string& f) {
-        std::string h=sha256(fGPT);
+        std::string h=sha256File(fGPT); // Contents, not the path
         load(f);
         if (h!=sha) {
             std::cout << "New data detected. Incremental training starting...\n";
@@ -47,7 +47,7 @@ namespace GPT {
                 const std::string userInput = convo["user_input"];
                 const std::string systemResponse = convo["system_response"];
 
-                // Add user input and system response as nodes to the network
+                // Add user input and system response as nodes to the network; a reload merges into them
                 nnet.addN(userInput, "input", 1.0f);
                 nnet.addN(systemResponse, "output", 0.0f);
 
@@ -65,7 +65,7 @@ namespace GPT {
         nnet.addN(userInput, "input", 1.0f);
         nnet.addN(correctResponse, "output", 0.0f);
         nnet.addS(userInput, correctResponse, 0.5f);
-        nnet.fwd();  // Update the network
+        nnet.fwd();  // Update the network: only the new synapse's destination and what it feeds
         nnet.validate();
         std::cout << "Model updated incrementally.\n";
     }
@@ -77,6 +77,7 @@ namespace GPT {
             std::cout << "Training epoch " << epoch + 1 << "/" << epochs << std::endl;
             // Optionally introduce noise or variability for stochastic updates
             nnet.addWeightNoise(0.01f);
+            nnet.prune(0.05f, 3);  // Drop relationships that have stayed weak for a few epochs
             adjustParameters(epoch);
         }
 
@@ -94,40 +95,28 @@ namespace GPT {
     std::string genResp(const std::string& userInput) {
         // Forward propagate user input through the network
         auto contextEmbedding = embeddingModel.getContextEmbedding({userInput});
-        nnet.addN(userInput, "input", 1.0f);  // Ensure user input is in the network
+        // Ensure user input is in the network; if it is, only what it feeds is re-evaluated by the next fwd()
+        uint32_t n = nnet.addN(userInput, "input", 1.0f);
+        nnet.setValue(n, 1.0f);
 
-        // Find the strongest connected response
+        // Find the strongest connected response: the head of the ranked outgoing synapses
         std::string bestResponse;
-        float maxWeight = -1.0f;
-
-        for (const auto& syn : nnet.synapses) {
-            if (syn.src == userInput && syn.weight > maxWeight) {
-                maxWeight = syn.weight;
-                bestResponse = syn.dest;
-            }
-        }
+        if (uint32_t e = nnet.best(n); e != N3R::NNet::npos && nnet.synapses[e].weight > -1.0f)
+            bestResponse = nnet.name(nnet.synapses[e].d);
 
         return bestResponse.empty() ? "I don't know yet." : bestResponse;
     }
 
     // Save the model to disk
     void save(const std::string& filePath) {
-        std::ofstream file(filePath);
-        if (!file.is_open()) {
-            throw std::runtime_error("Error: Unable to save model to file.");
-        }
-        nnet.print();  // Save the network's current state
+        nnet.save(filePath);  // Binary snapshot of the network
         std::cout << "Model saved to " << filePath << ".\n";
     }
 
     // Load the model from disk
     void load(const std::string& filePath) {
-        std::ifstream file(filePath);
-        if (!file.is_open()) {
-            throw std::runtime_error("Error: Unable to load model from file.");
-        }
-        // Placeholder for loading logic
         std::cout << "Loading model from " << filePath << "...\n";
+        nnet.load(filePath);
     }
 
     // Interactive prompt for testing the conversation system
@@ -1,9 +1,57 @@
 #include <iostream>  // For std::cout, std::cin, std::endl
+#include <csignal>
+#include <cstring>
+#include <string>
 #include "Xi.h"
+#include "server.h"
+
+namespace {
+    Server* server = nullptr; // For the signal handler
+
+    void onSignal(int) {
+        if (server) server->stop();
+    }
+}
+
+// Usage: xi                                          interactive conversation on stdin
+//        xi --serve [socket] [--threads N] [--batch N]  answer clients on a Unix socket (default data/xi.sock)
+int main(int argc, char** argv) {
+    std::string sock;
+    unsigned threads = 0;
+    size_t batch = 16;
+    bool serve = false;
+    for (int i = 1; i < argc; ++i) {
+        if (!std::strcmp(argv[i], "--serve")) {
+            serve = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') sock = argv[++i];
+        } else if (!std::strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = unsigned(std::stoul(argv[++i]));
+        } else if (!std::strcmp(argv[i], "--batch") && i + 1 < argc) {
+            batch = std::stoul(argv[++i]);
+        } else {
+            std::cerr << "Unknown argument: " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    try {
+        Xi::loadModel("data/model.xlm"); // Trains on new conversations in data/gpt.zip first
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl; // The saved model is left as it was
+        return 1;
+    }
+
+    if (serve) {
+        Server s(sock.empty() ? "data/xi.sock" : sock,
+                 [](std::string_view req) { return Xi::generateResponse(std::string(req)); }, threads, batch);
+        server = &s;
+        std::signal(SIGINT, onSignal);
+        std::signal(SIGTERM, onSignal);
+        s.run();
+        server = nullptr;
+        return 0;
+    }
 
-int main() {
-    Xi::loadModel("data/model.bz2");
-    Xi::train(10);
     // Example conversation loop
     std::string userInput;
     while (true) {
@@ -0,0 +1,76 @@
+#include "pool.h"
+#include <algorithm>
+
+Pool::Pool(unsigned threads) {
+    n = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned t = 1; t < n; ++t) {
+        th.emplace_back(&Pool::loop, this, t);
+    }
+}
+
+Pool::~Pool() {
+    {
+        std::lock_guard<std::mutex> lk(m);
+        stop = true;
+    }
+    go.notify_all();
+    for (auto& t : th) t.join();
+}
+
+// Helper thread: wait for a new phase, run it, report completion
+void Pool::loop(unsigned t) {
+    uint64_t seen = 0;
+    while (true) {
+        const std::function<void(unsigned)>* fn;
+        {
+            std::unique_lock<std::mutex> lk(m);
+            go.wait(lk, [&] { return stop || gen != seen; });
+            if (stop) return;
+            seen = gen;
+            fn = job;
+        }
+        try {
+            (*fn)(t);
+        } catch (...) {
+            std::lock_guard<std::mutex> lk(m);
+            if (!err) err = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lk(m);
+        if (--left == 0) done.notify_one();
+    }
+}
+
+void Pool::run(const std::function<void(unsigned)>& fn) {
+    if (n == 1) {
+        fn(0);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lk(m);
+        job = &fn;
+        left = n - 1;
+        err = nullptr;
+        ++gen;
+    }
+    go.notify_all();
+
+    std::exception_ptr own;
+    try {
+        fn(0);
+    } catch (...) {
+        own = std::current_exception();
+    }
+
+    std::unique_lock<std::mutex> lk(m);
+    done.wait(lk, [&] { return left == 0; });
+    job = nullptr;
+    if (own) std::rethrow_exception(own);
+    if (err) std::rethrow_exception(err);
+}
+
+void Pool::each(size_t count, const std::function<void(size_t, size_t, unsigned)>& fn) {
+    run([&](unsigned t) {
+        size_t b = count * t / n, e = count * (t + 1) / n;
+        if (b < e) fn(b, e, t);
+    });
+}
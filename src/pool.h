@@ -0,0 +1,75 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <vector>
+#include <cstdint>
+#include <deque>
+
+// Fixed set of worker threads running fork-join phases. The calling thread takes part as worker 0,
+// so a pool of size 1 runs everything inline.
+class Pool {
+    unsigned n;                                  // Workers including the caller
+    std::vector<std::thread> th;                 // Helper threads 1..n-1
+    std::mutex m;
+    std::condition_variable go, done;
+    const std::function<void(unsigned)>* job = nullptr;
+    uint64_t gen = 0;                            // Phase counter
+    unsigned left = 0;                           // Helpers still running the current phase
+    bool stop = false;
+    std::exception_ptr err;                      // First exception thrown by a helper
+
+    void loop(unsigned t);
+public:
+    explicit Pool(unsigned threads = 0); // 0 = hardware concurrency
+    ~Pool();
+    Pool(const Pool&) = delete;
+    Pool& operator=(const Pool&) = delete;
+
+    unsigned size() const { return n; }
+    void run(const std::function<void(unsigned)>& fn); // fn(t) on every worker; returns when all finish (barrier)
+    void each(size_t count, const std::function<void(size_t, size_t, unsigned)>& fn); // fn(begin, end, t) over an even split of [0, count)
+};
+
+// Bounded blocking queue between pipeline stages. push() waits while the queue is full and pop() while
+// it is empty; after close(), push() refuses and pop() drains what is left, then reports the end.
+template <typename T>
+class Queue {
+    std::deque<T> q;
+    size_t cap;
+    bool closed = false;
+    std::mutex m;
+    std::condition_variable notFull, notEmpty;
+public:
+    explicit Queue(size_t capacity) : cap(capacity ? capacity : 1) {}
+
+    bool push(T v) { // false once closed (the consumer gave up)
+        std::unique_lock<std::mutex> lk(m);
+        notFull.wait(lk, [&] { return closed || q.size() < cap; });
+        if (closed) return false;
+        q.push_back(std::move(v));
+        notEmpty.notify_one();
+        return true;
+    }
+    bool pop(T& v) { // false once closed and drained
+        std::unique_lock<std::mutex> lk(m);
+        notEmpty.wait(lk, [&] { return closed || !q.empty(); });
+        if (q.empty()) return false;
+        v = std::move(q.front());
+        q.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+    void close() {
+        std::lock_guard<std::mutex> lk(m);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+};
+
+#endif // POOL_H
@@ -0,0 +1,121 @@
+#include "rng.h"
+#include <atomic>
+#include <cstdlib>
+#include <random>
+
+namespace {
+    constexpr int L = 8;  // Generator lanes
+    constexpr int B = 64; // Buffered values for scalar draws
+
+    std::atomic<uint64_t> gSeed{0};
+    std::atomic<bool> gSet{false};   // seed() called; otherwise the default seed applies
+    std::atomic<uint64_t> gEpoch{1}; // Bumped by seed(); threads compare against theirs
+    std::atomic<uint64_t> gNextId{1ull << 63}; // Automatic stream IDs; explicit ones (stream()) stay below
+
+    uint64_t splitmix(uint64_t& x) {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t initialSeed() {
+        if (const char* s = std::getenv("XI_SEED")) return std::strtoull(s, nullptr, 10);
+        std::random_device rd;
+        return (uint64_t(rd()) << 32) | rd();
+    }
+
+    uint64_t current() {
+        static const uint64_t dflt = initialSeed();
+        return gSet.load(std::memory_order_acquire) ? gSeed.load(std::memory_order_relaxed) : dflt;
+    }
+
+    struct State {
+        alignas(32) uint32_t s[4][L]; // xoshiro128+ state, one column per lane
+        alignas(32) float buf[B];
+        int pos = B;
+        uint64_t epoch = 0;
+        uint64_t id = gNextId.fetch_add(1, std::memory_order_relaxed);
+
+        void reseed() {
+            epoch = gEpoch.load(std::memory_order_acquire);
+            uint64_t x = current() ^ (id * 0xd1342543de82ef95ull);
+            for (int l = 0; l < L; ++l) {
+                for (int k = 0; k < 4; k += 2) {
+                    uint64_t v = splitmix(x);
+                    s[k][l] = static_cast<uint32_t>(v);
+                    s[k + 1][l] = static_cast<uint32_t>(v >> 32) | 1; // Never all zero
+                }
+            }
+            pos = B;
+        }
+
+        State& ready() {
+            if (epoch != gEpoch.load(std::memory_order_relaxed)) reseed();
+            return *this;
+        }
+
+        // Next L raw values, one per lane
+        void next(uint32_t* out) {
+            for (int l = 0; l < L; ++l) {
+                out[l] = s[0][l] + s[3][l];
+                uint32_t t = s[1][l] << 9;
+                s[2][l] ^= s[0][l];
+                s[3][l] ^= s[1][l];
+                s[1][l] ^= s[2][l];
+                s[0][l] ^= s[3][l];
+                s[2][l] ^= t;
+                s[3][l] = (s[3][l] << 11) | (s[3][l] >> 21);
+            }
+        }
+
+        // Top 24 bits -> [lo, hi)
+        void fill(float* x, size_t n, float lo, float hi) {
+            const float k = (hi - lo) * (1.0f / 16777216.0f);
+            alignas(32) uint32_t r[L];
+            size_t i = 0;
+            for (; i + L <= n; i += L) {
+                next(r);
+                for (int l = 0; l < L; ++l) x[i + l] = lo + static_cast<float>(r[l] >> 8) * k;
+            }
+            if (i < n) {
+                next(r);
+                for (int l = 0; i < n; ++i, ++l) x[i] = lo + static_cast<float>(r[l] >> 8) * k;
+            }
+        }
+    };
+
+    thread_local State st;
+}
+
+namespace Rng {
+    void seed(uint64_t s) {
+        gSeed.store(s, std::memory_order_relaxed);
+        gSet.store(true, std::memory_order_release);
+        gEpoch.fetch_add(1, std::memory_order_release);
+    }
+
+    uint64_t seed() {
+        return current();
+    }
+
+    void stream(uint64_t id) {
+        id &= (1ull << 63) - 1; // Keep clear of the automatic IDs
+        if (st.id == id && st.epoch == gEpoch.load(std::memory_order_relaxed)) return;
+        st.id = id;
+        st.reseed();
+    }
+
+    float uniform() {
+        State& g = st.ready();
+        if (g.pos == B) {
+            g.fill(g.buf, B, 0.0f, 1.0f);
+            g.pos = 0;
+        }
+        return g.buf[g.pos++];
+    }
+
+    void fill(float* x, size_t n, float lo, float hi) {
+        st.ready().fill(x, n, lo, hi);
+    }
+}
@@ -0,0 +1,264 @@
+#include "server.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "utils.h"
+
+namespace {
+    constexpr uint64_t kListen = 0, kWake = UINT64_MAX; // epoll tags besides connection ids
+    constexpr size_t kMaxFrame = 16u << 20;
+    constexpr size_t kBacklog = 1u << 20; // Stop reading / dispatching past this much buffered per connection
+
+    uint32_t le32(const char* p) {
+        auto b = reinterpret_cast<const unsigned char*>(p);
+        return b[0] | b[1] << 8 | b[2] << 16 | uint32_t(b[3]) << 24;
+    }
+
+    void frame(std::string& out, std::string_view payload) {
+        uint32_t n = uint32_t(payload.size());
+        char h[4] = {char(n), char(n >> 8), char(n >> 16), char(n >> 24)};
+        out.append(h, 4);
+        out.append(payload);
+    }
+
+    std::runtime_error sysError(const std::string& what) {
+        return std::runtime_error("Error: " + what + ": " + std::strerror(errno));
+    }
+}
+
+Server::Server(const std::string& path, Handler handler, unsigned threads, size_t batch)
+    : path(path), handler(std::move(handler)), batch(batch ? batch : 1), jobs(1u << 16) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path))
+        throw std::runtime_error("Error: Invalid socket path: " + path);
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    // Clean up whatever the constructor opened before throwing; the destructor will not run
+    auto fail = [&](const std::string& what) {
+        auto e = sysError(what);
+        for (int fd : {lfd, ep, ev})
+            if (fd >= 0) ::close(fd);
+        return e;
+    };
+
+    // A stale socket from an earlier run is replaced; any other file is left alone
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) unlink(path.c_str());
+
+    lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (lfd < 0) throw fail("socket");
+    if (bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) throw fail("bind " + path);
+    if (listen(lfd, SOMAXCONN) < 0) {
+        unlink(path.c_str());
+        throw fail("listen " + path);
+    }
+    ep = epoll_create1(EPOLL_CLOEXEC);
+    ev = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    epoll_event e{};
+    e.events = EPOLLIN;
+    bool ok = ep >= 0 && ev >= 0;
+    e.data.u64 = kListen;
+    ok = ok && epoll_ctl(ep, EPOLL_CTL_ADD, lfd, &e) == 0;
+    e.data.u64 = kWake;
+    ok = ok && epoll_ctl(ep, EPOLL_CTL_ADD, ev, &e) == 0;
+    if (!ok) {
+        unlink(path.c_str());
+        throw fail("epoll");
+    }
+
+    unsigned n = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned t = 0; t < n; ++t) workers.emplace_back(&Server::work, this);
+}
+
+Server::~Server() {
+    stopping = true;
+    jobs.close();
+    for (auto& t : workers) t.join();
+    for (auto& [id, c] : conns) ::close(c.fd);
+    ::close(lfd);
+    ::close(ep);
+    ::close(ev);
+    unlink(path.c_str());
+}
+
+void Server::stop() {
+    stopping = true;
+    uint64_t one = 1;
+    [[maybe_unused]] auto r = ::write(ev, &one, sizeof(one));
+}
+
+void Server::run() {
+    Utils::log(Utils::Log::INFO, "Serving on " + path + " with " + std::to_string(workers.size()) + " workers");
+    epoll_event evs[64];
+    while (!stopping) {
+        int n = epoll_wait(ep, evs, 64, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw sysError("epoll_wait");
+        }
+        for (int i = 0; i < n; ++i) {
+            uint64_t id = evs[i].data.u64;
+            if (id == kListen) accept();
+            else if (id == kWake) finish();
+            else {
+                // A hung-up peer can no longer read answers; one that only shut down writing still can
+                if (evs[i].events & (EPOLLHUP | EPOLLERR)) {
+                    close(id);
+                    continue;
+                }
+                if (evs[i].events & EPOLLIN) receive(id);
+                if (evs[i].events & EPOLLOUT) flush(id);
+                update(id);
+            }
+        }
+    }
+}
+
+void Server::accept() {
+    while (true) {
+        int fd = accept4(lfd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) Utils::log(Utils::Log::ERROR, sysError("accept").what());
+            return;
+        }
+        uint64_t id = next++;
+        epoll_event e{};
+        e.events = EPOLLIN;
+        e.data.u64 = id;
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &e) < 0) {
+            ::close(fd);
+            continue;
+        }
+        conns.emplace(id, Conn{fd, {}, {}, EPOLLIN});
+    }
+}
+
+void Server::receive(uint64_t id) {
+    auto it = conns.find(id);
+    if (it == conns.end()) return;
+    Conn& c = it->second;
+    char buf[1 << 16];
+    while (!c.eof && c.in.size() <= kMaxFrame + 4) {
+        ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+        if (n > 0) c.in.append(buf, size_t(n));
+        else if (n == 0) c.eof = true;
+        else if (errno == EINTR) continue;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+        else return close(id);
+    }
+}
+
+void Server::flush(uint64_t id) {
+    auto it = conns.find(id);
+    if (it == conns.end()) return;
+    Conn& c = it->second;
+    size_t sent = 0;
+    while (sent < c.out.size()) {
+        ssize_t n = send(c.fd, c.out.data() + sent, c.out.size() - sent, MSG_NOSIGNAL);
+        if (n >= 0) sent += size_t(n);
+        else if (errno == EINTR) continue;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+        else return close(id);
+    }
+    c.out.erase(0, sent);
+}
+
+void Server::update(uint64_t id) {
+    auto it = conns.find(id);
+    if (it == conns.end()) return;
+    Conn& c = it->second;
+
+    // One job per connection at a time keeps responses in request order
+    if (!c.busy && c.out.size() < kBacklog) {
+        Job job{id, {}};
+        size_t pos = 0;
+        while (job.reqs.size() < batch && c.in.size() - pos >= 4) {
+            size_t len = le32(c.in.data() + pos);
+            if (len > kMaxFrame) {
+                Utils::log(Utils::Log::ERROR, "Closing client: frame of " + std::to_string(len) + " bytes");
+                return close(id);
+            }
+            if (c.in.size() - pos - 4 < len) break;
+            job.reqs.emplace_back(c.in, pos + 4, len);
+            pos += 4 + len;
+        }
+        c.in.erase(0, pos);
+        if (!job.reqs.empty()) {
+            c.busy = true;
+            jobs.push(std::move(job));
+        }
+    }
+
+    if (c.eof && !c.busy && c.out.empty()) return close(id);
+
+    // Level-triggered: read only while there is room, write only while output is pending
+    uint32_t want = (!c.eof && c.in.size() <= kMaxFrame + 4 ? EPOLLIN : 0) | (c.out.empty() ? 0 : EPOLLOUT);
+    if (want != c.events) {
+        epoll_event e{};
+        e.events = want;
+        e.data.u64 = id;
+        if (epoll_ctl(ep, EPOLL_CTL_MOD, c.fd, &e) < 0) return close(id);
+        c.events = want;
+    }
+}
+
+void Server::finish() {
+    uint64_t count;
+    [[maybe_unused]] auto r = ::read(ev, &count, sizeof(count));
+    std::vector<Done> ready;
+    {
+        std::lock_guard<std::mutex> lk(m);
+        ready.swap(done);
+    }
+    for (auto& d : ready) {
+        auto it = conns.find(d.id);
+        if (it == conns.end()) continue; // Client left while its job ran
+        it->second.busy = false;
+        it->second.out += d.out;
+        flush(d.id);
+        update(d.id);
+    }
+}
+
+void Server::close(uint64_t id) {
+    auto it = conns.find(id);
+    if (it == conns.end()) return;
+    epoll_ctl(ep, EPOLL_CTL_DEL, it->second.fd, nullptr);
+    ::close(it->second.fd);
+    conns.erase(it);
+}
+
+// Worker: answer each request of a job in order, then wake the event loop
+void Server::work() {
+    Job job;
+    while (jobs.pop(job)) {
+        Done d{job.id, {}};
+        for (const auto& req : job.reqs) {
+            std::string resp;
+            try {
+                resp = handler(req);
+            } catch (const std::exception& e) {
+                resp = std::string("Error: ") + e.what();
+            } catch (...) {
+                resp = "Error: unknown";
+            }
+            if (resp.size() > kMaxFrame) resp = "Error: response too large";
+            frame(d.out, resp);
+        }
+        {
+            std::lock_guard<std::mutex> lk(m);
+            done.push_back(std::move(d));
+        }
+        uint64_t one = 1;
+        [[maybe_unused]] auto r = ::write(ev, &one, sizeof(one));
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "pool.h"
+
+/**
+ * Request server on a Unix domain socket: one epoll event loop (the thread calling run()) does all socket
+ * I/O and hands requests to a pool of worker threads.
+ *
+ * Protocol: each request and each response is a frame, a u32 little-endian payload length followed by
+ * the payload (at most 16 MB). Responses come back in request order on the same connection. A client may
+ * pipeline frames; up to `batch` frames waiting on one connection go to a worker as one job. A handler
+ * that throws answers "Error: <what>".
+ */
+class Server {
+public:
+    using Handler = std::function<std::string(std::string_view)>; // Called from several workers at once
+
+    Server(const std::string& path, Handler handler, unsigned threads = 0, size_t batch = 16); // 0 = all cores
+    ~Server();
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    void run();  // Serve until stop()
+    void stop(); // Make run() return; async-signal-safe
+
+private:
+    struct Conn {
+        int fd;
+        std::string in, out;  // Unparsed request bytes, unsent response bytes
+        uint32_t events;     // What epoll currently watches for
+        bool busy = false;   // A job from this connection is with the workers
+        bool eof = false;    // Peer finished sending; close once answered
+    };
+    struct Job {
+        uint64_t id;
+        std::vector<std::string> reqs;
+    };
+    struct Done {
+        uint64_t id;
+        std::string out; // Framed responses
+    };
+
+    std::string path;
+    Handler handler;
+    size_t batch;
+    int lfd = -1, ep = -1, ev = -1; // Listening socket, epoll, wake-up eventfd
+    std::unordered_map<uint64_t, Conn> conns;
+    uint64_t next = 1;
+    Queue<Job> jobs;
+    std::mutex m;
+    std::vector<Done> done; // Finished jobs, guarded by m
+    std::atomic<bool> stopping{false};
+    std::vector<std::thread> workers;
+
+    void accept();
+    void receive(uint64_t id);
+    void flush(uint64_t id);  // Send what the socket takes of the pending output
+    void update(uint64_t id); // Queue the next batch if idle, adjust the epoll interest, close when done
+    void finish();            // Collect finished jobs
+    void close(uint64_t id);
+    void work();
+};
+
+#endif // SERVER_H
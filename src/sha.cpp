@@ -0,0 +1,305 @@
+#include "sha.h"
+#include "utils.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <vector>
+#include <sys/mman.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#include <cpuid.h>
+#define SHA_X86 1
+#endif
+
+namespace {
+    // SHA-256 constants
+    alignas(64) const uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+    const uint32_t H0[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+
+    inline uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+    inline uint32_t load32(const uint8_t* p) {
+        return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | uint32_t(p[3]);
+    }
+    inline void store32(uint8_t* p, uint32_t v) {
+        p[0] = uint8_t(v >> 24);
+        p[1] = uint8_t(v >> 16);
+        p[2] = uint8_t(v >> 8);
+        p[3] = uint8_t(v);
+    }
+
+    // Final block(s) of a message whose last rem (< 64) bytes are at p: 0x80, zeros, bit length. Returns 1 or 2.
+    size_t tail(uint8_t* out, const uint8_t* p, size_t rem, uint64_t total) {
+        size_t blocks = rem + 9 > 64 ? 2 : 1;
+        std::memset(out, 0, 64 * blocks);
+        if (rem) std::memcpy(out, p, rem);
+        out[rem] = 0x80;
+        uint64_t bits = total * 8;
+        store32(out + 64 * blocks - 8, uint32_t(bits >> 32));
+        store32(out + 64 * blocks - 4, uint32_t(bits));
+        return blocks;
+    }
+
+    // Portable fallback: n consecutive 64-byte blocks into state h
+    void compressS(uint32_t* h, const uint8_t* p, size_t n) {
+        for (; n > 0; --n, p += 64) {
+            uint32_t w[64];
+            for (int t = 0; t < 16; ++t) w[t] = load32(p + 4 * t);
+            for (int t = 16; t < 64; ++t) {
+                uint32_t s0 = rotr(w[t - 15], 7) ^ rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+                uint32_t s1 = rotr(w[t - 2], 17) ^ rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+                w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+            }
+            uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], hh = h[7];
+            for (int t = 0; t < 64; ++t) {
+                uint32_t t1 = hh + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[t] + w[t];
+                uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+                hh = g;
+                g = f;
+                f = e;
+                e = d + t1;
+                d = c;
+                c = b;
+                b = a;
+                a = t1 + t2;
+            }
+            h[0] += a;
+            h[1] += b;
+            h[2] += c;
+            h[3] += d;
+            h[4] += e;
+            h[5] += f;
+            h[6] += g;
+            h[7] += hh;
+        }
+    }
+
+    void manyS(const std::string_view* msgs, size_t n, Sha::Digest* out) {
+        for (size_t i = 0; i < n; ++i) out[i] = Sha::hash(msgs[i]);
+    }
+
+#ifdef SHA_X86
+    // SHA extensions: the state lives as ABEF / CDGH halves, four rounds per message word group
+    __attribute__((target("sha,sse4.1,ssse3"))) void compressNI(uint32_t* h, const uint8_t* p, size_t n) {
+        const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+        __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h)), 0xB1);    // CDAB
+        __m128i s1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h + 4)), 0x1B); // EFGH
+        __m128i s0 = _mm_alignr_epi8(tmp, s1, 8);                                                       // ABEF
+        s1 = _mm_blend_epi16(s1, tmp, 0xF0);                                                            // CDGH
+        for (; n > 0; --n, p += 64) {
+            __m128i abef = s0, cdgh = s1, m[4];
+#pragma GCC unroll 16
+            for (int i = 0; i < 16; ++i) {
+                __m128i& x = m[i & 3]; // Words 4i..4i+3; before the update it holds words 4i-16..4i-13
+                if (i < 4) {
+                    x = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16 * i)), bswap);
+                } else {
+                    x = _mm_sha256msg1_epu32(x, m[(i - 3) & 3]);
+                    x = _mm_add_epi32(x, _mm_alignr_epi8(m[(i - 1) & 3], m[(i - 2) & 3], 4));
+                    x = _mm_sha256msg2_epu32(x, m[(i - 1) & 3]);
+                }
+                __m128i wk = _mm_add_epi32(x, _mm_load_si128(reinterpret_cast<const __m128i*>(K + 4 * i)));
+                s1 = _mm_sha256rnds2_epu32(s1, s0, wk);
+                s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(wk, 0x0E));
+            }
+            s0 = _mm_add_epi32(s0, abef);
+            s1 = _mm_add_epi32(s1, cdgh);
+        }
+        tmp = _mm_shuffle_epi32(s0, 0x1B);   // FEBA
+        s1 = _mm_shuffle_epi32(s1, 0xB1);    // DCHG
+        s0 = _mm_blend_epi16(tmp, s1, 0xF0); // DCBA
+        s1 = _mm_alignr_epi8(s1, tmp, 8);    // HGFE
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(h), s0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(h + 4), s1);
+    }
+
+    template <int n> __attribute__((target("avx2"))) inline __m256i ror8(__m256i x) {
+        return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+    }
+
+    // Eight messages in lockstep, one per 32-bit lane: s[i] holds state word i of every lane. blk[l] is
+    // lane l's next block, or null once the lane has finished, which leaves its state alone.
+    __attribute__((target("avx2"))) void compress8(__m256i* s, const uint8_t* const* blk) {
+        alignas(32) uint32_t wl[16][8];
+        alignas(32) int32_t live[8];
+        for (int l = 0; l < 8; ++l) {
+            live[l] = blk[l] ? -1 : 0;
+            for (int t = 0; t < 16; ++t) wl[t][l] = blk[l] ? load32(blk[l] + 4 * t) : 0;
+        }
+        __m256i w[16];
+        for (int t = 0; t < 16; ++t) w[t] = _mm256_load_si256(reinterpret_cast<const __m256i*>(wl[t]));
+
+        __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], hh = s[7];
+        for (int t = 0; t < 64; ++t) {
+            if (t >= 16) {
+                __m256i x = w[(t - 15) & 15], y = w[(t - 2) & 15];
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ror8<7>(x), ror8<18>(x)), _mm256_srli_epi32(x, 3));
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ror8<17>(y), ror8<19>(y)), _mm256_srli_epi32(y, 10));
+                w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+            }
+            __m256i S1 = _mm256_xor_si256(_mm256_xor_si256(ror8<6>(e), ror8<11>(e)), ror8<25>(e));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(hh, S1),
+                                          _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(K[t])), w[t & 15])));
+            __m256i S0 = _mm256_xor_si256(_mm256_xor_si256(ror8<2>(a), ror8<13>(a)), ror8<22>(a));
+            __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+            hh = g;
+            g = f;
+            f = e;
+            e = _mm256_add_epi32(d, t1);
+            d = c;
+            c = b;
+            b = a;
+            a = _mm256_add_epi32(t1, _mm256_add_epi32(S0, maj));
+        }
+        __m256i mask = _mm256_load_si256(reinterpret_cast<const __m256i*>(live));
+        __m256i v[8] = {a, b, c, d, e, f, g, hh};
+        for (int i = 0; i < 8; ++i) s[i] = _mm256_blendv_epi8(s[i], _mm256_add_epi32(s[i], v[i]), mask);
+    }
+
+    __attribute__((target("avx2"))) void manyAVX2(const std::string_view* msgs, size_t n, Sha::Digest* out) {
+        // Messages of similar length share a group, so few lanes sit idle
+        std::vector<uint32_t> ord(n);
+        std::iota(ord.begin(), ord.end(), 0u);
+        std::sort(ord.begin(), ord.end(), [&](uint32_t x, uint32_t y) { return msgs[x].size() < msgs[y].size(); });
+
+        alignas(64) uint8_t tails[8][128];
+        for (size_t g0 = 0; g0 < n; g0 += 8) {
+            size_t k = std::min<size_t>(8, n - g0), full[8] = {}, blocks[8] = {}, most = 0;
+            const uint8_t* data[8] = {};
+            for (size_t l = 0; l < k; ++l) {
+                std::string_view m = msgs[ord[g0 + l]];
+                data[l] = reinterpret_cast<const uint8_t*>(m.data());
+                full[l] = m.size() / 64;
+                blocks[l] = full[l] + tail(tails[l], data[l] + 64 * full[l], m.size() % 64, m.size());
+                most = std::max(most, blocks[l]);
+            }
+            __m256i s[8];
+            for (int i = 0; i < 8; ++i) s[i] = _mm256_set1_epi32(static_cast<int>(H0[i]));
+            for (size_t j = 0; j < most; ++j) {
+                const uint8_t* blk[8] = {};
+                for (size_t l = 0; l < k; ++l) {
+                    if (j < blocks[l]) blk[l] = j < full[l] ? data[l] + 64 * j : tails[l] + 64 * (j - full[l]);
+                }
+                compress8(s, blk);
+            }
+            alignas(32) uint32_t st[8][8];
+            for (int i = 0; i < 8; ++i) _mm256_store_si256(reinterpret_cast<__m256i*>(st[i]), s[i]);
+            for (size_t l = 0; l < k; ++l) {
+                for (int i = 0; i < 8; ++i) store32(out[ord[g0 + l]].data() + 4 * i, st[i][l]);
+            }
+        }
+    }
+
+    bool hasSHA() {
+        unsigned a, b, c, d;
+        return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & (1u << 29)) && __builtin_cpu_supports("sse4.1") &&
+               __builtin_cpu_supports("ssse3");
+    }
+#endif
+
+    // Kernel table, picked once on first use
+    struct Kern {
+        const char* name;
+        void (*compress)(uint32_t*, const uint8_t*, size_t);
+        void (*many)(const std::string_view*, size_t, Sha::Digest*);
+    };
+
+    Kern pick() {
+#ifdef SHA_X86
+        __builtin_cpu_init();
+        if (hasSHA()) return {"sha-ni", compressNI, manyS}; // One stream already runs at full speed
+        if (__builtin_cpu_supports("avx2")) return {"avx2", compressS, manyAVX2};
+#endif
+        return {"scalar", compressS, manyS};
+    }
+
+    const Kern& kern() {
+        static const Kern k = pick();
+        return k;
+    }
+} // namespace
+
+namespace Sha {
+    void Sha256::init() {
+        std::memcpy(h, H0, sizeof(h));
+        used = 0;
+        total = 0;
+    }
+
+    void Sha256::update(const void* data, size_t n) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        total += n;
+        if (used) {
+            size_t k = std::min(n, 64 - used);
+            std::memcpy(buf + used, p, k);
+            used += k;
+            p += k;
+            n -= k;
+            if (used < 64) return;
+            kern().compress(h, buf, 1);
+            used = 0;
+        }
+        if (n >= 64) {
+            kern().compress(h, p, n / 64); // Whole blocks straight from the input
+            p += n / 64 * 64;
+            n %= 64;
+        }
+        std::memcpy(buf + used, p, n);
+        used += n;
+    }
+
+    Digest Sha256::final() {
+        uint8_t last[128];
+        size_t blocks = tail(last, buf, used, total);
+        kern().compress(h, last, blocks);
+        Digest d;
+        for (int i = 0; i < 8; ++i) store32(d.data() + 4 * i, h[i]);
+        return d;
+    }
+
+    Digest hash(const void* p, size_t n) {
+        Sha256 s;
+        s.update(p, n);
+        return s.final();
+    }
+
+    Digest file(const std::string& path) {
+        MMap m(path);
+        char* p = m.data();
+        constexpr size_t step = size_t(64) << 20; // Page aligned
+        if (p) madvise(p, m.size(), MADV_SEQUENTIAL);
+        Sha256 s;
+        for (size_t off = 0; off < m.size(); off += step) {
+            size_t k = std::min(step, m.size() - off);
+            s.update(p + off, k);
+            madvise(p + off, k, MADV_DONTNEED); // Read-only file pages: dropped now, so memory stays flat
+        }
+        return s.final();
+    }
+
+    void many(const std::string_view* msgs, size_t n, Digest* out) { kern().many(msgs, n, out); }
+
+    std::string hex(const Digest& d) {
+        static constexpr char digits[] = "0123456789abcdef";
+        std::string s(64, '\0');
+        for (size_t i = 0; i < d.size(); ++i) {
+            s[2 * i] = digits[d[i] >> 4];
+            s[2 * i + 1] = digits[d[i] & 15];
+        }
+        return s;
+    }
+
+    const char* isa() { return kern().name; }
+}
@@ -0,0 +1,40 @@
+#ifndef SHA_H
+#define SHA_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// SHA-256 (FIPS 180-4). Blocks are compressed with the SHA extensions when the CPU has them, otherwise
+// with a portable loop; hashing many messages at once runs 8 of them side by side in AVX2 lanes when
+// there are no SHA extensions. The implementation is picked once, on first use.
+namespace Sha {
+    using Digest = std::array<uint8_t, 32>;
+
+    // Streaming hash: update() any number of times, then final(). init() starts over.
+    class Sha256 {
+        uint32_t h[8];
+        uint8_t buf[64];
+        size_t used;    // Bytes waiting in buf
+        uint64_t total; // Bytes hashed so far
+    public:
+        Sha256() { init(); }
+        void init();
+        void update(const void* p, size_t n);
+        Digest final(); // Digest of everything since init(); call init() before reusing
+    };
+
+    Digest hash(const void* p, size_t n);
+    inline Digest hash(std::string_view s) { return hash(s.data(), s.size()); }
+    Digest file(const std::string& path); // Mapped and hashed in place; consumed pages are released as it goes
+
+    // out[i] = hash(msgs[i]) for n independent messages (e.g. per-record content addresses)
+    void many(const std::string_view* msgs, size_t n, Digest* out);
+
+    std::string hex(const Digest& d); // Lowercase hex, 64 characters
+    const char* isa();                // "sha-ni", "avx2" or "scalar"
+}
+
+#endif // SHA_H
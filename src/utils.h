@@ -2,6 +2,8 @@
 #define UTILS_H
 
 #include <string>
+#include <string_view>
+#include <cstdint>
 #include <vector>
 #include <unordered_map>
 #include <sstream>
@@ -11,9 +13,64 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <new>
+#include <cstddef>
+#include "vec.h"
+#include "rng.h"
+
+// Allocator returning A-byte aligned storage (row slabs for vector kernels)
+template <typename T, std::size_t A = 64>
+struct AlignedAlloc {
+    using value_type = T;
+    template <typename U> struct rebind { using other = AlignedAlloc<U, A>; };
+    AlignedAlloc() = default;
+    template <typename U> AlignedAlloc(const AlignedAlloc<U, A>&) {}
+    T* allocate(std::size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(A))); }
+    void deallocate(T* p, std::size_t) { ::operator delete(p, std::align_val_t(A)); }
+    template <typename U> bool operator==(const AlignedAlloc<U, A>&) const { return true; }
+};
+
+// Memory mapping of a whole file. cow = private writable pages (writes never reach the file).
+class MMap {
+    char* p = nullptr;
+    size_t n = 0;
+public:
+    explicit MMap(const std::string& path, bool cow = false);
+    ~MMap();
+    MMap(const MMap&) = delete;
+    MMap& operator=(const MMap&) = delete;
+    char* data() { return p; }
+    const char* data() const { return p; }
+    size_t size() const { return n; }
+};
+
+// SHA-256 as lowercase hex (see sha.h for streaming and batched hashing)
+std::string sha256(const std::string &input);
+std::string sha256File(const std::string& path); // SHA-256 of a file's contents, hashed in place
+
+// 64-bit FNV-1a: stable across runs and platforms, so it can be persisted
+inline uint64_t fnv1a(std::string_view s) {
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (unsigned char c : s) h = (h ^ c) * 0x100000001b3ull;
+    return h;
+}
+
+// Explicit little-endian field access for the binary file formats (.xlm models, .hnsw indexes)
+inline uint32_t le32(const void* p) {
+    const unsigned char* b = static_cast<const unsigned char*>(p);
+    return b[0] | (b[1] << 8) | (b[2] << 16) | (uint32_t(b[3]) << 24);
+}
+inline uint64_t le64(const void* p) {
+    return le32(p) | (uint64_t(le32(static_cast<const char*>(p) + 4)) << 32);
+}
+inline void put32(char* p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) p[i] = static_cast<char>(v >> (8 * i));
+}
+inline void put64(char* p, uint64_t v) {
+    put32(p, static_cast<uint32_t>(v));
+    put32(p + 4, static_cast<uint32_t>(v >> 32));
+}
 
-// Full SHA-256 hash implementation
-    std::string sha256(const std::string &input);
 // Helper function to trim whitespace
 inline std::string trim(const std::string& str) {
     size_t first = str.find_first_not_of(" \t\n");
@@ -21,29 +78,22 @@ inline std::string trim(const std::string& str) {
     return (first == std::string::npos || last == std::string::npos) ? "" : str.substr(first, last - first + 1);
 }
 
-// Generate a random float
+// Generate a random float (thread-safe, see rng.h)
 inline float randomFloat(float min = -0.05f, float max = 0.05f) {
-    static std::random_device rd;
-    static std::mt19937 gen(rd());
-    std::uniform_real_distribution<float> dist(min, max);
-    return dist(gen);
+    return Rng::uniform(min, max);
 }
 
 // Normalize a vector to unit length
 inline void normalizeVector(std::vector<float>& vec) {
-    float magnitude = std::sqrt(std::inner_product(vec.begin(), vec.end(), vec.begin(), 0.0f));
-    if (magnitude > 0.0f) {
-        for (float& v : vec) {
-            v /= magnitude;
-        }
-    }
+    Vec::normalize(vec.data(), vec.size());
 }
 
 // Add stochastic noise to a vector
 inline void addNoise(std::vector<float>& vec, float factor, float min = -1.0f, float max = 1.0f) {
-    for (float& v : vec) {
-        v += randomFloat(min, max) * factor;
-    }
+    thread_local std::vector<float> r;
+    r.resize(vec.size());
+    Rng::fill(r.data(), r.size(), min, max);
+    Vec::axpy(factor, r.data(), vec.data(), vec.size());
 }
 
 // Generic function to find the matching closing bracket in a tokenized list
@@ -61,6 +111,8 @@ inline size_t FindClose(const Container& tokens, size_t start, char open, char c
 
 namespace Utils {
     std::unordered_map<std::string, std::vector<std::string>> chat(const std::string& filePath, std::unordered_map<std::string, std::string>& nodeData);
+    // Same, over JSON text already in memory (one conversation record, or a whole export)
+    std::unordered_map<std::string, std::vector<std::string>> chatJSON(const std::string& json, std::unordered_map<std::string, std::string>& nodeData);
     std::vector<std::pair<int64_t, std::string>> readTopic(const std::string& filePath, const std::string& topic);
     void appendToBzip2(const std::string& filePath, const std::string& topic, const std::vector<std::pair<int64_t, std::string>>& messages);
     enum class Log { NONE, ERROR, INFO, DEBUG };
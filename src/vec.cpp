@@ -0,0 +1,515 @@
+#include "vec.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VEC_X86 1
+#endif
+
+namespace {
+    // Portable fallback, also used for tails
+    float dotS(const float* a, const float* b, size_t n) {
+        float s = 0.0f;
+        for (size_t i = 0; i < n; ++i) s += a[i] * b[i];
+        return s;
+    }
+    void axpyS(float a, const float* x, float* y, size_t n) {
+        for (size_t i = 0; i < n; ++i) y[i] += a * x[i];
+    }
+    void scaleS(float* x, float a, size_t n) {
+        for (size_t i = 0; i < n; ++i) x[i] *= a;
+    }
+    void poolS(const float* base, size_t stride, const uint32_t* rows, size_t k, float* out, size_t n) {
+        for (size_t i = 0; i < n; ++i) out[i] = 0.0f;
+        for (size_t j = 0; j < k; ++j) {
+            const float* r = base + rows[j] * stride;
+            for (size_t i = 0; i < n; ++i) out[i] += r[i];
+        }
+    }
+    void hebbS(const float* p, float* w, float* c, float lr, float reg, size_t n) {
+        for (size_t i = 0; i < n; ++i) {
+            float g = (p[i] * w[i] * c[i]) - reg;
+            w[i] += lr * g;
+            c[i] += lr * g;
+        }
+    }
+
+    void tanhS(float* x, size_t n) {
+        for (size_t i = 0; i < n; ++i) x[i] = std::tanh(x[i]);
+    }
+
+    // IEEE half <-> float, round to nearest even
+    inline float h2f(uint16_t h) {
+        uint32_t s = (h & 0x8000u) << 16, e = (h >> 10) & 0x1f, m = h & 0x3ff, bits;
+        if (e == 0) {
+            if (m == 0) {
+                bits = s;
+            } else { // Subnormal: renormalize
+                e = 113;
+                while (!(m & 0x400)) {
+                    m <<= 1;
+                    --e;
+                }
+                bits = s | (e << 23) | ((m & 0x3ff) << 13);
+            }
+        } else if (e == 31) {
+            bits = s | 0x7f800000u | (m << 13);
+        } else {
+            bits = s | ((e + 112) << 23) | (m << 13);
+        }
+        float f;
+        std::memcpy(&f, &bits, 4);
+        return f;
+    }
+    inline uint16_t f2h(float f) {
+        uint32_t x;
+        std::memcpy(&x, &f, 4);
+        uint32_t s = (x >> 16) & 0x8000, m = x & 0x7fffff;
+        int32_t e = static_cast<int32_t>((x >> 23) & 0xff) - 112;
+        if (((x >> 23) & 0xff) == 0xff) return static_cast<uint16_t>(s | 0x7c00 | (m ? 0x200 : 0));
+        if (e >= 31) return static_cast<uint16_t>(s | 0x7c00);
+        int shift = 13;
+        uint32_t h;
+        if (e <= 0) { // Subnormal half
+            if (e < -10) return static_cast<uint16_t>(s);
+            m |= 0x800000;
+            shift = 14 - e;
+            h = m >> shift;
+        } else {
+            h = (static_cast<uint32_t>(e) << 10) | (m >> 13);
+        }
+        uint32_t rem = m & ((1u << shift) - 1), half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (h & 1))) ++h; // Carry into the exponent is correct rounding
+        return static_cast<uint16_t>(s | h);
+    }
+
+    float dotF16S(const float* x, const uint16_t* h, size_t n) {
+        float s = 0.0f;
+        for (size_t i = 0; i < n; ++i) s += x[i] * h2f(h[i]);
+        return s;
+    }
+    float dotI8S(const float* x, const int8_t* q, size_t n) {
+        float s = 0.0f;
+        for (size_t i = 0; i < n; ++i) s += x[i] * q[i];
+        return s;
+    }
+    void axpyF16S(float a, const uint16_t* h, float* y, size_t n) {
+        for (size_t i = 0; i < n; ++i) y[i] += a * h2f(h[i]);
+    }
+    void axpyI8S(float a, const int8_t* q, float* y, size_t n) {
+        for (size_t i = 0; i < n; ++i) y[i] += a * q[i];
+    }
+
+#ifdef VEC_X86
+    inline float hsum128(__m128 v) {
+        v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+        v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+        return _mm_cvtss_f32(v);
+    }
+
+    // SSE2 (baseline on x86-64)
+    __attribute__((target("sse2"))) float dotSSE(const float* a, const float* b, size_t n) {
+        __m128 s = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) s = _mm_add_ps(s, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        return hsum128(s) + dotS(a + i, b + i, n - i);
+    }
+    __attribute__((target("sse2"))) void axpySSE(float a, const float* x, float* y, size_t n) {
+        __m128 va = _mm_set1_ps(a);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+        axpyS(a, x + i, y + i, n - i);
+    }
+    __attribute__((target("sse2"))) void scaleSSE(float* x, float a, size_t n) {
+        __m128 va = _mm_set1_ps(a);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) _mm_storeu_ps(x + i, _mm_mul_ps(_mm_loadu_ps(x + i), va));
+        scaleS(x + i, a, n - i);
+    }
+    __attribute__((target("sse2"))) void poolSSE(const float* base, size_t stride, const uint32_t* rows, size_t k, float* out, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128 s = _mm_setzero_ps();
+            for (size_t j = 0; j < k; ++j) s = _mm_add_ps(s, _mm_loadu_ps(base + rows[j] * stride + i));
+            _mm_storeu_ps(out + i, s);
+        }
+        for (; i < n; ++i) {
+            float s = 0.0f;
+            for (size_t j = 0; j < k; ++j) s += base[rows[j] * stride + i];
+            out[i] = s;
+        }
+    }
+    __attribute__((target("sse2"))) void hebbSSE(const float* p, float* w, float* c, float lr, float reg, size_t n) {
+        __m128 vl = _mm_set1_ps(lr), vr = _mm_set1_ps(reg);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128 vw = _mm_loadu_ps(w + i), vc = _mm_loadu_ps(c + i);
+            __m128 g = _mm_mul_ps(vl, _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(p + i), vw), vc), vr));
+            _mm_storeu_ps(w + i, _mm_add_ps(vw, g));
+            _mm_storeu_ps(c + i, _mm_add_ps(vc, g));
+        }
+        hebbS(p + i, w + i, c + i, lr, reg, n - i);
+    }
+
+    // tanh for vector lanes (Cephes tanhf / expf, within a few ulp of std::tanh): an odd polynomial
+    // below |x| = 0.625, else sign(x) * (1 - 2 / (exp(2|x|) + 1)) with exp by range reduction.
+    constexpr float kT0 = -5.70498872745e-3f, kT1 = 2.06390887954e-2f, kT2 = -5.37397155531e-2f,
+                    kT3 = 1.33314422036e-1f, kT4 = -3.33332819422e-1f;
+    constexpr float kE0 = 1.9875691500e-4f, kE1 = 1.3981999507e-3f, kE2 = 8.3334519073e-3f,
+                    kE3 = 4.1665795894e-2f, kE4 = 1.6666665459e-1f, kE5 = 5.0000001201e-1f;
+    constexpr float kLog2e = 1.44269504089f, kLn2Hi = 0.693359375f, kLn2Lo = -2.12194440e-4f;
+
+    // AVX2 + FMA
+    __attribute__((target("avx2,fma"))) float dotAVX2(const float* a, const float* b, size_t n) {
+        __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+            s1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), s1);
+        }
+        for (; i + 8 <= n; i += 8) s0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), s0);
+        s0 = _mm256_add_ps(s0, s1);
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(s0), _mm256_extractf128_ps(s0, 1));
+        return hsum128(s) + dotS(a + i, b + i, n - i);
+    }
+    __attribute__((target("avx2,fma"))) void axpyAVX2(float a, const float* x, float* y, size_t n) {
+        __m256 va = _mm256_set1_ps(a);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+        axpyS(a, x + i, y + i, n - i);
+    }
+    __attribute__((target("avx2,fma"))) void scaleAVX2(float* x, float a, size_t n) {
+        __m256 va = _mm256_set1_ps(a);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) _mm256_storeu_ps(x + i, _mm256_mul_ps(_mm256_loadu_ps(x + i), va));
+        scaleS(x + i, a, n - i);
+    }
+    __attribute__((target("avx2,fma"))) void poolAVX2(const float* base, size_t stride, const uint32_t* rows, size_t k, float* out, size_t n) {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 s = _mm256_setzero_ps();
+            for (size_t j = 0; j < k; ++j) s = _mm256_add_ps(s, _mm256_loadu_ps(base + rows[j] * stride + i));
+            _mm256_storeu_ps(out + i, s);
+        }
+        for (; i < n; ++i) {
+            float s = 0.0f;
+            for (size_t j = 0; j < k; ++j) s += base[rows[j] * stride + i];
+            out[i] = s;
+        }
+    }
+    __attribute__((target("avx2,fma"))) void hebbAVX2(const float* p, float* w, float* c, float lr, float reg, size_t n) {
+        __m256 vl = _mm256_set1_ps(lr), vr = _mm256_set1_ps(reg);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 vw = _mm256_loadu_ps(w + i), vc = _mm256_loadu_ps(c + i);
+            __m256 g = _mm256_fmsub_ps(_mm256_mul_ps(_mm256_loadu_ps(p + i), vw), vc, vr);
+            _mm256_storeu_ps(w + i, _mm256_fmadd_ps(vl, g, vw));
+            _mm256_storeu_ps(c + i, _mm256_fmadd_ps(vl, g, vc));
+        }
+        hebbS(p + i, w + i, c + i, lr, reg, n - i);
+    }
+
+    __attribute__((target("avx2,fma,f16c"))) float dotF16AVX2(const float* x, const uint16_t* h, size_t n) {
+        __m256 s = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 v = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i)));
+            s = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), v, s);
+        }
+        __m128 r = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+        return hsum128(r) + dotF16S(x + i, h + i, n - i);
+    }
+    __attribute__((target("avx2,fma"))) float dotI8AVX2(const float* x, const int8_t* q, size_t n) {
+        __m256 s = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i w = _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(q + i)));
+            s = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_cvtepi32_ps(w), s);
+        }
+        __m128 r = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+        return hsum128(r) + dotI8S(x + i, q + i, n - i);
+    }
+    __attribute__((target("avx2,fma,f16c"))) void axpyF16AVX2(float a, const uint16_t* h, float* y, size_t n) {
+        __m256 va = _mm256_set1_ps(a);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 v = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(h + i)));
+            _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, v, _mm256_loadu_ps(y + i)));
+        }
+        axpyF16S(a, h + i, y + i, n - i);
+    }
+    __attribute__((target("avx2,fma"))) void axpyI8AVX2(float a, const int8_t* q, float* y, size_t n) {
+        __m256 va = _mm256_set1_ps(a);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256i w = _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(q + i)));
+            _mm256_storeu_ps(y + i, _mm256_fmadd_ps(va, _mm256_cvtepi32_ps(w), _mm256_loadu_ps(y + i)));
+        }
+        axpyI8S(a, q + i, y + i, n - i);
+    }
+
+    __attribute__((target("avx2,fma"))) inline __m256 exp8(__m256 v) {
+        __m256 n = _mm256_round_ps(_mm256_mul_ps(v, _mm256_set1_ps(kLog2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(kLn2Hi), v);
+        r = _mm256_fnmadd_ps(n, _mm256_set1_ps(kLn2Lo), r);
+        __m256 p = _mm256_set1_ps(kE0);
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kE1));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kE2));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kE3));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kE4));
+        p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(kE5));
+        p = _mm256_fmadd_ps(_mm256_mul_ps(p, r), r, _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+        __m256i e = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+        return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+    }
+    __attribute__((target("avx2,fma"))) void tanhAVX2(float* x, size_t n) {
+        const __m256 sign = _mm256_set1_ps(-0.0f), one = _mm256_set1_ps(1.0f);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 v = _mm256_loadu_ps(x + i);
+            __m256 a = _mm256_andnot_ps(sign, v);
+            __m256 z = _mm256_mul_ps(v, v);
+            __m256 p = _mm256_set1_ps(kT0);
+            p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(kT1));
+            p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(kT2));
+            p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(kT3));
+            p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(kT4));
+            __m256 small = _mm256_fmadd_ps(_mm256_mul_ps(p, z), v, v);
+            __m256 e = exp8(_mm256_min_ps(_mm256_add_ps(a, a), _mm256_set1_ps(88.0f)));
+            __m256 big = _mm256_sub_ps(one, _mm256_div_ps(_mm256_set1_ps(2.0f), _mm256_add_ps(e, one)));
+            big = _mm256_or_ps(big, _mm256_and_ps(sign, v));
+            _mm256_storeu_ps(x + i, _mm256_blendv_ps(big, small, _mm256_cmp_ps(a, _mm256_set1_ps(0.625f), _CMP_LT_OQ)));
+        }
+        tanhS(x + i, n - i);
+    }
+
+    // AVX-512F: masked loads/stores handle the tail.
+    // GCC 12's own intrinsic headers trip -Wmaybe-uninitialized (_mm512_undefined_*) here.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#pragma GCC diagnostic ignored "-Wuninitialized"
+    inline __mmask16 tail16(size_t r) { return static_cast<__mmask16>((1u << r) - 1); }
+
+    __attribute__((target("avx512f"))) float dotAVX512(const float* a, const float* b, size_t n) {
+        __m512 s = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) s = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), s);
+        if (i < n) {
+            __mmask16 m = tail16(n - i);
+            s = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(m, a + i), _mm512_maskz_loadu_ps(m, b + i), s);
+        }
+        alignas(64) float t[16];
+        _mm512_store_ps(t, s);
+        __m128 h = _mm_add_ps(_mm_add_ps(_mm_load_ps(t), _mm_load_ps(t + 4)), _mm_add_ps(_mm_load_ps(t + 8), _mm_load_ps(t + 12)));
+        return hsum128(h);
+    }
+    __attribute__((target("avx512f"))) void axpyAVX512(float a, const float* x, float* y, size_t n) {
+        __m512 va = _mm512_set1_ps(a);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+        if (i < n) {
+            __mmask16 m = tail16(n - i);
+            _mm512_mask_storeu_ps(y + i, m, _mm512_fmadd_ps(va, _mm512_maskz_loadu_ps(m, x + i), _mm512_maskz_loadu_ps(m, y + i)));
+        }
+    }
+    __attribute__((target("avx512f"))) void scaleAVX512(float* x, float a, size_t n) {
+        __m512 va = _mm512_set1_ps(a);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) _mm512_storeu_ps(x + i, _mm512_mul_ps(_mm512_loadu_ps(x + i), va));
+        if (i < n) {
+            __mmask16 m = tail16(n - i);
+            _mm512_mask_storeu_ps(x + i, m, _mm512_mul_ps(_mm512_maskz_loadu_ps(m, x + i), va));
+        }
+    }
+    __attribute__((target("avx512f"))) void poolAVX512(const float* base, size_t stride, const uint32_t* rows, size_t k, float* out, size_t n) {
+        for (size_t i = 0; i < n; i += 16) {
+            __mmask16 m = n - i >= 16 ? static_cast<__mmask16>(0xFFFF) : tail16(n - i);
+            __m512 s = _mm512_setzero_ps();
+            for (size_t j = 0; j < k; ++j) s = _mm512_add_ps(s, _mm512_maskz_loadu_ps(m, base + rows[j] * stride + i));
+            _mm512_mask_storeu_ps(out + i, m, s);
+        }
+    }
+    __attribute__((target("avx512f"))) void hebbAVX512(const float* p, float* w, float* c, float lr, float reg, size_t n) {
+        __m512 vl = _mm512_set1_ps(lr), vr = _mm512_set1_ps(reg);
+        for (size_t i = 0; i < n; i += 16) {
+            __mmask16 m = n - i >= 16 ? static_cast<__mmask16>(0xFFFF) : tail16(n - i);
+            __m512 vw = _mm512_maskz_loadu_ps(m, w + i), vc = _mm512_maskz_loadu_ps(m, c + i);
+            __m512 g = _mm512_fmsub_ps(_mm512_mul_ps(_mm512_maskz_loadu_ps(m, p + i), vw), vc, vr);
+            _mm512_mask_storeu_ps(w + i, m, _mm512_fmadd_ps(vl, g, vw));
+            _mm512_mask_storeu_ps(c + i, m, _mm512_fmadd_ps(vl, g, vc));
+        }
+    }
+    __attribute__((target("avx512f"))) float dotF16AVX512(const float* x, const uint16_t* h, size_t n) {
+        __m512 s = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m512 v = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i)));
+            s = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), v, s);
+        }
+        alignas(64) float t[16];
+        _mm512_store_ps(t, s);
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_load_ps(t), _mm_load_ps(t + 4)), _mm_add_ps(_mm_load_ps(t + 8), _mm_load_ps(t + 12)));
+        return hsum128(r) + dotF16S(x + i, h + i, n - i);
+    }
+    __attribute__((target("avx512f"))) float dotI8AVX512(const float* x, const int8_t* q, size_t n) {
+        __m512 s = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m512i w = _mm512_cvtepi8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(q + i)));
+            s = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_cvtepi32_ps(w), s);
+        }
+        alignas(64) float t[16];
+        _mm512_store_ps(t, s);
+        __m128 r = _mm_add_ps(_mm_add_ps(_mm_load_ps(t), _mm_load_ps(t + 4)), _mm_add_ps(_mm_load_ps(t + 8), _mm_load_ps(t + 12)));
+        return hsum128(r) + dotI8S(x + i, q + i, n - i);
+    }
+    __attribute__((target("avx512f"))) void axpyF16AVX512(float a, const uint16_t* h, float* y, size_t n) {
+        __m512 va = _mm512_set1_ps(a);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m512 v = _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(h + i)));
+            _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, v, _mm512_loadu_ps(y + i)));
+        }
+        axpyF16S(a, h + i, y + i, n - i);
+    }
+    __attribute__((target("avx512f"))) void axpyI8AVX512(float a, const int8_t* q, float* y, size_t n) {
+        __m512 va = _mm512_set1_ps(a);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m512i w = _mm512_cvtepi8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(q + i)));
+            _mm512_storeu_ps(y + i, _mm512_fmadd_ps(va, _mm512_cvtepi32_ps(w), _mm512_loadu_ps(y + i)));
+        }
+        axpyI8S(a, q + i, y + i, n - i);
+    }
+    __attribute__((target("avx512f"))) inline __m512 exp16(__m512 v) {
+        __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(v, _mm512_set1_ps(kLog2e)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(kLn2Hi), v);
+        r = _mm512_fnmadd_ps(n, _mm512_set1_ps(kLn2Lo), r);
+        __m512 p = _mm512_set1_ps(kE0);
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kE1));
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kE2));
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kE3));
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kE4));
+        p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(kE5));
+        p = _mm512_fmadd_ps(_mm512_mul_ps(p, r), r, _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+        return _mm512_scalef_ps(p, n);
+    }
+    __attribute__((target("avx512f"))) void tanhAVX512(float* x, size_t n) {
+        const __m512 one = _mm512_set1_ps(1.0f);
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m512 v = _mm512_loadu_ps(x + i);
+            __m512 a = _mm512_abs_ps(v);
+            __m512 z = _mm512_mul_ps(v, v);
+            __m512 p = _mm512_set1_ps(kT0);
+            p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(kT1));
+            p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(kT2));
+            p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(kT3));
+            p = _mm512_fmadd_ps(p, z, _mm512_set1_ps(kT4));
+            __m512 small = _mm512_fmadd_ps(_mm512_mul_ps(p, z), v, v);
+            __m512 e = exp16(_mm512_min_ps(_mm512_add_ps(a, a), _mm512_set1_ps(88.0f)));
+            __m512 big = _mm512_sub_ps(one, _mm512_div_ps(_mm512_set1_ps(2.0f), _mm512_add_ps(e, one)));
+            big = _mm512_castsi512_ps(_mm512_or_si512(_mm512_castps_si512(big),
+                                                      _mm512_and_si512(_mm512_castps_si512(v), _mm512_set1_epi32(INT32_MIN))));
+            __mmask16 lt = _mm512_cmp_ps_mask(a, _mm512_set1_ps(0.625f), _CMP_LT_OQ);
+            _mm512_storeu_ps(x + i, _mm512_mask_blend_ps(lt, big, small));
+        }
+        tanhS(x + i, n - i);
+    }
+#pragma GCC diagnostic pop
+#endif
+
+    // Kernel table, picked once on first use
+    struct Kern {
+        const char* name;
+        float (*dot)(const float*, const float*, size_t);
+        void (*axpy)(float, const float*, float*, size_t);
+        void (*scale)(float*, float, size_t);
+        void (*pool)(const float*, size_t, const uint32_t*, size_t, float*, size_t);
+        void (*hebb)(const float*, float*, float*, float, float, size_t);
+        float (*dotF16)(const float*, const uint16_t*, size_t);
+        float (*dotI8)(const float*, const int8_t*, size_t);
+        void (*axpyF16)(float, const uint16_t*, float*, size_t);
+        void (*axpyI8)(float, const int8_t*, float*, size_t);
+        void (*tanh)(float*, size_t);
+    };
+
+    Kern pick() {
+#ifdef VEC_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return {"avx512", dotAVX512, axpyAVX512, scaleAVX512, poolAVX512, hebbAVX512,
+                    dotF16AVX512, dotI8AVX512, axpyF16AVX512, axpyI8AVX512, tanhAVX512};
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+            return {"avx2", dotAVX2, axpyAVX2, scaleAVX2, poolAVX2, hebbAVX2,
+                    dotF16AVX2, dotI8AVX2, axpyF16AVX2, axpyI8AVX2, tanhAVX2};
+        if (__builtin_cpu_supports("sse2"))
+            return {"sse2", dotSSE, axpySSE, scaleSSE, poolSSE, hebbSSE,
+                    dotF16S, dotI8S, axpyF16S, axpyI8S, tanhS};
+#endif
+        return {"scalar", dotS, axpyS, scaleS, poolS, hebbS, dotF16S, dotI8S, axpyF16S, axpyI8S, tanhS};
+    }
+
+    const Kern& kern() {
+        static const Kern k = pick();
+        return k;
+    }
+} // namespace
+
+namespace Vec {
+    float dot(const float* a, const float* b, size_t n) { return kern().dot(a, b, n); }
+    void axpy(float a, const float* x, float* y, size_t n) { kern().axpy(a, x, y, n); }
+    void scale(float* x, float a, size_t n) { kern().scale(x, a, n); }
+    float norm(const float* x, size_t n) { return std::sqrt(kern().dot(x, x, n)); }
+    void pool(const float* base, size_t stride, const uint32_t* rows, size_t k, float* out, size_t n) {
+        kern().pool(base, stride, rows, k, out, n);
+    }
+    void hebb(const float* p, float* w, float* c, float lr, float reg, size_t n) {
+        if (w == c) return hebbS(p, w, c, lr, reg, n); // Aliased rows take the update twice, element by element
+        kern().hebb(p, w, c, lr, reg, n);
+    }
+    void tanh(float* x, size_t n) { kern().tanh(x, n); }
+    const char* isa() { return kern().name; }
+
+    float dotF16(const float* x, const uint16_t* h, size_t n) { return kern().dotF16(x, h, n); }
+    float dotI8(const float* x, const int8_t* q, size_t n) { return kern().dotI8(x, q, n); }
+    void axpyF16(float a, const uint16_t* h, float* y, size_t n) { kern().axpyF16(a, h, y, n); }
+    void axpyI8(float a, const int8_t* q, float* y, size_t n) { kern().axpyI8(a, q, y, n); }
+
+    void toF16(const float* x, uint16_t* h, size_t n) {
+        for (size_t i = 0; i < n; ++i) h[i] = f2h(x[i]);
+    }
+    void fromF16(const uint16_t* h, float* x, size_t n) {
+        for (size_t i = 0; i < n; ++i) x[i] = h2f(h[i]);
+    }
+    float toI8(const float* x, int8_t* q, size_t n) {
+        float m = 0.0f;
+        for (size_t i = 0; i < n; ++i) m = std::max(m, std::fabs(x[i]));
+        float s = m > 0.0f ? m / 127.0f : 1.0f;
+        for (size_t i = 0; i < n; ++i) q[i] = static_cast<int8_t>(std::lrint(x[i] / s));
+        return s;
+    }
+
+    float Rows::dot(const float* x, uint32_t r) const {
+        const char* p = static_cast<const char*>(base) + r * stride * width(type);
+        switch (type) {
+            case Type::F16: return dotF16(x, reinterpret_cast<const uint16_t*>(p), dim);
+            case Type::I8: return scale[r] * dotI8(x, reinterpret_cast<const int8_t*>(p), dim);
+            default: return Vec::dot(x, reinterpret_cast<const float*>(p), dim);
+        }
+    }
+    void Rows::add(uint32_t r, float a, float* y) const {
+        const char* p = static_cast<const char*>(base) + r * stride * width(type);
+        switch (type) {
+            case Type::F16: axpyF16(a, reinterpret_cast<const uint16_t*>(p), y, dim); break;
+            case Type::I8: axpyI8(a * scale[r], reinterpret_cast<const int8_t*>(p), y, dim); break;
+            default: axpy(a, reinterpret_cast<const float*>(p), y, dim);
+        }
+    }
+    void Rows::get(uint32_t r, float* out) const {
+        std::fill(out, out + dim, 0.0f);
+        add(r, 1.0f, out);
+    }
+}
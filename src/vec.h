@@ -0,0 +1,53 @@
+#ifndef VEC_H
+#define VEC_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Dense float kernels with SSE2 / AVX2 / AVX-512 variants selected once at startup (CPUID).
+namespace Vec {
+    float dot(const float* a, const float* b, size_t n);           // sum a[i]*b[i]
+    void axpy(float a, const float* x, float* y, size_t n);         // y += a*x
+    void scale(float* x, float a, size_t n);                        // x *= a
+    float norm(const float* x, size_t n);                           // |x|
+    void pool(const float* base, size_t stride, const uint32_t* rows, size_t k,
+              float* out, size_t n);                                // out = sum of rows base[rows[j]*stride]
+    void hebb(const float* p, float* w, float* c, float lr, float reg, size_t n); // g = p*w*c - reg; w += lr*g; c += lr*g
+    void tanh(float* x, size_t n);                                  // x = tanh(x), within a few ulp of std::tanh
+
+    // Quantized rows: fp16 (IEEE half) and int8 with a per-row scale
+    float dotF16(const float* x, const uint16_t* h, size_t n);      // sum x[i]*h[i]
+    float dotI8(const float* x, const int8_t* q, size_t n);         // sum x[i]*q[i] (caller applies scale)
+    void axpyF16(float a, const uint16_t* h, float* y, size_t n);   // y += a*h
+    void axpyI8(float a, const int8_t* q, float* y, size_t n);      // y += a*q
+    void toF16(const float* x, uint16_t* h, size_t n);              // Round to nearest even
+    void fromF16(const uint16_t* h, float* x, size_t n);
+    float toI8(const float* x, int8_t* q, size_t n);                // Returns the scale (max|x| / 127)
+
+    // Element type of a row matrix
+    enum class Type : uint32_t { F32 = 0, F16 = 1, I8 = 2 };
+    inline size_t width(Type t) { return t == Type::F32 ? 4 : t == Type::F16 ? 2 : 1; }
+
+    // Read-only view of a row-major matrix in any Type; scale holds per-row scales for I8
+    struct Rows {
+        const void* base = nullptr;
+        size_t stride = 0; // Elements per row (>= dim)
+        size_t dim = 0;
+        Type type = Type::F32;
+        const float* scale = nullptr;
+
+        float dot(const float* x, uint32_t r) const;   // x . row r
+        void add(uint32_t r, float a, float* y) const; // y += a * row r
+        void get(uint32_t r, float* out) const;        // Row r as f32
+    };
+
+    // Normalize x to unit length (no-op for the zero vector)
+    inline void normalize(float* x, size_t n) {
+        float m = norm(x, n);
+        if (m > 0.0f) scale(x, 1.0f / m, n);
+    }
+
+    const char* isa(); // Name of the selected instruction set
+}
+
+#endif // VEC_H
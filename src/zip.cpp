@@ -5,15 +5,18 @@
 #include <fstream>
 #include <iterator> // Include for std::istream_iterator
 #include <string>   // Include for std::string
+#include <vector>
+#include <algorithm>
+#include "utils.h"
 
 Zip::Zip(const std::string& filePath) {
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file.is_open()) {
+    try {
+        mm = std::make_shared<MMap>(filePath); // Mapped, not copied: only the pages being inflated stay resident
+    } catch (const std::runtime_error&) {
         throw std::runtime_error("Failed to open zip file: " + filePath);
     }
-
-    file.unsetf(std::ios::skipws); // Disable skipping whitespace
-    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()); // Use streambuf iterator
+    buf = reinterpret_cast<const unsigned char*>(mm->data());
+    len = mm->size();
 }
 
 // File Header Structure
@@ -31,38 +34,33 @@ struct FH {
     uint16_t xLen;
 };
 
-void Zip::ext(const std::string& fn, const std::function<void(const char*, int)>& cb) {
-    int i = 0; // Signed input index or offset
-    if (i < 0) {
-        throw std::runtime_error("Index 'i' is negative, which is invalid.");
-    }
-
-    uint64_t l = static_cast<uint64_t>(i); // Cast to unsigned after validation
-
-    while (l < data.size()) {
-        if (l + 30 > data.size()) {
+// Walk the local file headers to fn's data
+size_t Zip::find(const std::string& fn, uint16_t& method, uint16_t& flags, uint32_t& cS) const {
+    uint64_t l = 0;
+    while (l < len) {
+        if (l + 30 > len) {
             throw std::runtime_error("Unexpected end of data while reading file header");
         }
 
-        // Process using 'l'
-        uint16_t nameLen = data[l + 26] | (data[l + 27] << 8);
-        uint16_t extraLen = data[l + 28] | (data[l + 29] << 8);
-        uint32_t compressedSize = data[l + 18] | (data[l + 19] << 8) | (data[l + 20] << 16) | (data[l + 21] << 24);
+        uint16_t nameLen = buf[l + 26] | (buf[l + 27] << 8);
+        uint16_t extraLen = buf[l + 28] | (buf[l + 29] << 8);
+        uint32_t compressedSize = buf[l + 18] | (buf[l + 19] << 8) | (buf[l + 20] << 16) | (uint32_t(buf[l + 21]) << 24);
 
-        if (l + 30 + nameLen > data.size()) {
+        if (l + 30 + nameLen > len) {
             throw std::runtime_error("Unexpected end of data while reading file name");
         }
 
-        std::string currentName(reinterpret_cast<const char*>(&data[l + 30]), nameLen);
+        std::string currentName(reinterpret_cast<const char*>(&buf[l + 30]), nameLen);
 
         if (currentName == fn) {
+            method = buf[l + 8] | (buf[l + 9] << 8);
+            flags = buf[l + 6] | (buf[l + 7] << 8);
+            cS = compressedSize;
             size_t offset = l + 30 + nameLen + extraLen;
-            if (offset + compressedSize > data.size()) {
+            if (offset + compressedSize > len) {
                 throw std::runtime_error("Unexpected end of data while reading file content");
             }
-
-            cb(reinterpret_cast<const char*>(&data[offset]), compressedSize);
-            return;
+            return offset;
         }
 
         l += 30 + nameLen + extraLen + compressedSize;
@@ -71,6 +69,53 @@ void Zip::ext(const std::string& fn, const std::function<void(const char*, int)>
     throw std::runtime_error("File not found in archive: " + fn);
 }
 
+void Zip::ext(const std::string& fn, const std::function<void(const char*, int)>& cb) {
+    uint16_t method, flags;
+    uint32_t cS;
+    size_t offset = find(fn, method, flags, cS);
+    cb(reinterpret_cast<const char*>(&buf[offset]), cS);
+}
+
+void Zip::stream(const std::string& fn, const std::function<void(const char*, size_t)>& cb, size_t chunk) const {
+    uint16_t method, flags;
+    uint32_t cS;
+    size_t offset = find(fn, method, flags, cS);
+    if (flags & 8) cS = static_cast<uint32_t>(std::min<size_t>(len - offset, UINT32_MAX)); // Sizes follow the data: inflate to the end marker
+    if (method == 0) {
+        for (size_t i = 0; i < cS; i += chunk) {
+            cb(reinterpret_cast<const char*>(&buf[offset + i]), std::min<size_t>(chunk, cS - i));
+        }
+        return;
+    }
+    if (method != 8) throw std::runtime_error("Unsupported compression method in archive: " + fn);
+
+    z_stream z{};
+    z.next_in = const_cast<Bytef*>(&buf[offset]);
+    z.avail_in = cS;
+    if (inflateInit2(&z, -MAX_WBITS) != Z_OK) throw std::runtime_error("zlib init failed");
+
+    std::vector<char> out(chunk);
+    int r;
+    do {
+        z.next_out = reinterpret_cast<Bytef*>(out.data());
+        z.avail_out = static_cast<uInt>(chunk);
+        r = inflate(&z, Z_NO_FLUSH);
+        if (r == Z_STREAM_ERROR || r == Z_DATA_ERROR || r == Z_MEM_ERROR || (r == Z_BUF_ERROR && z.avail_in == 0)) {
+            inflateEnd(&z);
+            throw std::runtime_error("Decompression error");
+        }
+        if (size_t n = chunk - z.avail_out) {
+            try {
+                cb(out.data(), n);
+            } catch (...) {
+                inflateEnd(&z);
+                throw;
+            }
+        }
+    } while (r != Z_STREAM_END);
+
+    inflateEnd(&z);
+}
 
 void Zip::procData(int i, int cS, int uS, const std::function<void(const char*, int)>& p) {
     if (i < 0 || cS < 0 || uS < 0) {
@@ -79,21 +124,21 @@ void Zip::procData(int i, int cS, int uS, const std::function<void(const char*,
 
     uint64_t l = static_cast<uint64_t>(i); // Cast to unsigned after validation
 
-    if (l + sizeof(FH) > data.size()) {
+    if (l + sizeof(FH) > len) {
         throw std::runtime_error("Offset exceeds data size at header parsing");
     }
 
-    FH* h = reinterpret_cast<FH*>(&data[l]);
+    const FH* h = reinterpret_cast<const FH*>(&buf[l]);
     std::cout << "Processing local file header at offset: " << i << std::endl;
     std::cout << "nLen: " << h->nLen << ", xLen: " << h->xLen << std::endl;
 
     l += 30 + h->nLen + h->xLen;
-    if (l + cS > data.size()) {
+    if (l + cS > len) {
         throw std::runtime_error("Compressed data offset exceeds file size");
     }
 
     z_stream z{};
-    z.next_in = reinterpret_cast<Bytef*>(&data[l]); // Use 'l' as the offset
+    z.next_in = const_cast<Bytef*>(&buf[l]); // Use 'l' as the offset
     z.avail_in = cS;
 
     if (inflateInit2(&z, -MAX_WBITS) != Z_OK) throw std::runtime_error("zlib init failed");
@@ -117,6 +162,9 @@ void Zip::procData(int i, int cS, int uS, const std::function<void(const char*,
 
 void Zip::read(const std::vector<unsigned char>& d) {
     data = d;
+    mm.reset();
+    buf = data.data();
+    len = data.size();
     size_t o = data.size() - 22; // Central directory offset
     if (o > data.size()) throw std::runtime_error("Invalid central directory offset");
 
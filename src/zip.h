@@ -5,16 +5,25 @@
 #include <functional>
 #include <cstdint>
 #include <string> // Add this for std::string
+#include <memory>
+
+class MMap;
 
 class Zip {
-    std::vector<unsigned char> data;
+    std::vector<unsigned char> data;  // Archive bytes given to read()
+    std::shared_ptr<MMap> mm;         // Archive file mapped by the constructor, paged in as it is read
+    const unsigned char* buf = nullptr;
+    size_t len = 0;
 
     void procData(int o, int cS, int uS, const std::function<void(const char*, int)>& p);
+    size_t find(const std::string& fn, uint16_t& method, uint16_t& flags, uint32_t& cS) const; // Offset of fn's data
 
 public:
     Zip() = default; // Default constructor
     explicit Zip(const std::string& filePath); // Constructor to initialize with file path
-    void ext(const std::string& fn, const std::function<void(const char*, int)>& cb); // Add this declaration
+    void ext(const std::string& fn, const std::function<void(const char*, int)>& cb); // Raw (compressed) bytes of fn
+    // Decompress fn (stored or deflated), handing cb one output chunk of at most `chunk` bytes at a time
+    void stream(const std::string& fn, const std::function<void(const char*, size_t)>& cb, size_t chunk = 1 << 16) const;
     void read(const std::vector<unsigned char>& d);
 };
 